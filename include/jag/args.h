@@ -25,6 +25,7 @@
 #define MODE_EXTRACT 1
 #define MODE_LIST 2
 #define MODE_CREATE 3
+#define MODE_BENCHMARK 4
 
 #define IDENT_HEXADECIMAL 0
 #define IDENT_DECIMAL 1
@@ -39,11 +40,14 @@ struct input_file {
 };
 
 struct jag_args {
-	int mode; /* one of MODE_{EXTRACT,LIST,CREATE} */
+	int mode; /* one of MODE_{EXTRACT,LIST,CREATE,BENCHMARK} */
 	char archive[255];
 	list_t input_files;
 	bool verbose;
 	int ident_mode;
+	bool whole;
+	int threads;
+	unsigned int heap_mb;
 };
 
 bool parse_args(jag_args_t* args, int argc, char** argv);
@@ -0,0 +1,32 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JAG_BUNZIP_H_
+#define _JAG_BUNZIP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUNZIP_BLOCK_MAGIC 0x314159265359ULL /* pi */
+#define BUNZIP_END_MAGIC 0x177245385090ULL /* sqrt(pi) */
+#define BUNZIP_MAGIC_BITS 48
+#define BUNZIP_MAX_THREADS 64
+
+bool bunzip_parallel(const uint8_t* in, size_t in_length, uint8_t* out, size_t out_length, int num_threads);
+
+#endif /* _JAG_BUNZIP_H_ */
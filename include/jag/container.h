@@ -0,0 +1,67 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JAG_CONTAINER_H_
+#define _JAG_CONTAINER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <runite/archive.h>
+#include <runite/file.h>
+
+#define CONTAINER_HEADER_SIZE 6 /* decompressed and compressed sizes, 3 bytes each */
+#define CONTAINER_ENTRY_SIZE 10 /* identifier, decompressed and compressed sizes */
+#define CONTAINER_MAX_THREADS 64
+#define CONTAINER_BZIP2_HEADER "BZh1" /* stripped from the compressed data */
+
+typedef struct container_entry container_entry_t;
+typedef struct container container_t;
+
+/**
+ * An entry of a container, as described by its entry table
+ */
+struct container_entry {
+	jhash_t identifier;
+	uint32_t length;
+	uint32_t compressed_length;
+	const uint8_t* data; /* compressed unless the container was compressed as a whole */
+};
+
+/**
+ * A container opened in place. A container compressed as a whole has its
+ * body decompressed, otherwise the body is within the file.
+ */
+struct container {
+	uint8_t* body;
+	size_t body_length;
+	bool whole;
+	int num_entries;
+	container_entry_t* entries;
+};
+
+uint32_t container_read24(const uint8_t* data);
+void container_write24(uint8_t* data, uint32_t value);
+bool container_compress(archive_t* archive, file_t* out, int num_threads);
+bool container_map(file_t* file, const char* path);
+void container_unmap(file_t* file);
+bool container_bunzip(const uint8_t* in, size_t in_length, uint8_t* out, size_t out_length);
+bool container_open(container_t* container, file_t* file, int num_threads);
+void container_close(container_t* container);
+bool container_extract(container_t* container, char** paths, int num_threads, size_t max_in_flight, bool verbose, char* error);
+
+#endif /* _JAG_CONTAINER_H_ */
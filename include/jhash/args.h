@@ -21,11 +21,18 @@
 #include <stdbool.h>
 #include <runite/util/list.h>
 #include <runite/hash.h>
+#include <jhash/mask.h>
 
 #define MODE_NONE 0
 #define MODE_HASH 1
 #define MODE_GEN_TABLE 2
 #define MODE_CRACK 3
+#define MODE_BENCHMARK 4
+#define MODE_MITM 5
+#define MODE_SERVE 6
+#define MODE_QUERY 7
+#define MODE_ATTACK 8
+#define MODE_MERGE 9
 
 #define HASH_HEXADECIMAL 0
 #define HASH_DECIMAL 1
@@ -33,15 +40,41 @@
 typedef struct jhash_args jhash_args_t;
 
 struct jhash_args {
-	int mode; /* one of MODE_{GEN_TABLE,CRACK} */
+	int mode; /* one of MODE_{HASH,GEN_TABLE,CRACK,BENCHMARK,MITM,SERVE,QUERY,ATTACK,MERGE} */
 	char table_path[255];
+	char** table_paths;
+	int num_table_paths;
+	char socket_path[108];
 	char target_string[32];
+	char** hash_strings;
+	int num_hash_strings;
 	jhash_t target_hash;
+	char targets_path[255];
 	char* charset;
+	int min_len; /* the first length to generate, set when extending a table */
 	int max_len;
+	bool max_len_given; /* whether -l was passed, rather than max_len being the default */
 	bool verbose;
 	int ident_mode;
 	unsigned int heap_mb;
+	int table_format; /* one of TABLE_FORMAT_{LEGACY,SORTED,COMPACT,HASHES,RAINBOW} */
+	int threads;
+	bool resume;
+	bool extend;
+	bool progress;
+	bool stop_on_found;
+	double bloom_fp; /* the target filter's false positive rate, or 0 */
+	unsigned int bloom_kb; /* the most memory the target filter may use, or 0 */
+	char* mask_spec;
+	char* custom_charsets[MASK_MAX_CUSTOM];
+	mask_t mask; /* parsed from mask_spec */
+	char wordlist_path[255];
+	char** rules;
+	int num_rules;
+	uint64_t chain_len;
+	uint64_t num_chains;
+	int shard;
+	int num_shards;
 };
 
 bool parse_args(jhash_args_t* args, int argc, char** argv);
@@ -0,0 +1,28 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JHASH_ATTACK_H_
+#define _JHASH_ATTACK_H_
+
+#include <jhash/args.h>
+
+#define ATTACK_SLICE_SIZE (1 << 16) /* ranks a worker takes from its range at a time */
+#define ATTACK_PROGRESS_INTERVAL 1.0 /* seconds between progress updates */
+
+void crack_attack(jhash_args_t* args);
+
+#endif /* _JHASH_ATTACK_H_ */
@@ -0,0 +1,35 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JHASH_BATCH_H_
+#define _JHASH_BATCH_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <runite/hash.h>
+
+#define BATCH_STRING_LEN 16 /* strings are null padded to this width, not necessarily terminated */
+
+typedef char batch_string_t[BATCH_STRING_LEN];
+
+void batch_init();
+bool batch_select(const char* name);
+const char* batch_kernel_name();
+void jagex_hash_batch(const batch_string_t* strings, size_t count, jhash_t* out);
+void jagex_hash_batch_scalar(const batch_string_t* strings, size_t count, jhash_t* out);
+
+#endif /* _JHASH_BATCH_H_ */
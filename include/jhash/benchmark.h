@@ -0,0 +1,28 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JHASH_BENCHMARK_H_
+#define _JHASH_BENCHMARK_H_
+
+#include <jhash/args.h>
+
+#define BENCH_CANDIDATES (1 << 24)
+#define BENCH_BATCH_TAILS 32 /* two iterations of the widest batch kernel, 16 strings each */
+
+void run_benchmark(jhash_args_t* args);
+
+#endif /* _JHASH_BENCHMARK_H_ */
@@ -0,0 +1,31 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JHASH_BULK_H_
+#define _JHASH_BULK_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <jhash/args.h>
+
+#define BULK_BUFFER_SIZE (1 << 20) /* the longest line which can be hashed */
+#define BULK_BATCH 4096
+
+uint64_t bulk_hash(FILE* in, FILE* out, int ident_mode);
+void bulk_hash_file(jhash_args_t* args);
+
+#endif /* _JHASH_BULK_H_ */
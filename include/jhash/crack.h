@@ -0,0 +1,31 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JHASH_CRACK_H_
+#define _JHASH_CRACK_H_
+
+#include <jhash/args.h>
+#include <jhash/targets.h>
+#include <jhash/table.h>
+
+typedef void (*crack_match_t)(void* data, jhash_t hash, const char* string);
+
+void crack_lookup_all(table_map_t* map, target_set_t* targets, crack_match_t match, void* data);
+void crack_load_targets(jhash_args_t* args, target_set_t* targets);
+void crack_table(jhash_args_t* args);
+
+#endif /* _JHASH_CRACK_H_ */
@@ -0,0 +1,91 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JHASH_KEYSPACE_H_
+#define _JHASH_KEYSPACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <runite/hash.h>
+
+/**
+ * A keyspace is every string of a given length over a charset, ranked in
+ * the order the generator enumerates them: the first character varies
+ * fastest, so rank r has charset[(r / n^i) % n] at position i.
+ */
+
+#define KEYSPACE_OVERFLOW UINT64_MAX
+#define KEYSPACE_MAX_LENGTH 16
+
+typedef struct keyspace_iter keyspace_iter_t;
+
+/**
+ * Enumerates a keyspace while hashing incrementally. The jagex hash is a
+ * polynomial in 61, so hash(s) = sum(value(s[i]) * 61^(length-1-i)) where
+ * value(c) = jagex_hash("c"). term[i][d] caches that product for digit d at
+ * position i, partial[i] caches the sum over positions i and up, and a step
+ * only recomputes the positions which changed. Each position has its own
+ * charset so that masks enumerate with the same iterator.
+ */
+struct keyspace_iter {
+	int length;
+	const char* charsets[KEYSPACE_MAX_LENGTH];
+	int radix[KEYSPACE_MAX_LENGTH];
+	int digits[KEYSPACE_MAX_LENGTH];
+	uint32_t term[KEYSPACE_MAX_LENGTH][256];
+	uint32_t partial[KEYSPACE_MAX_LENGTH+1];
+	char string[KEYSPACE_MAX_LENGTH+1];
+};
+
+uint64_t keyspace_size(int charset_len, int length);
+void keyspace_unrank(const char* charset, int length, uint64_t rank, const char** digits);
+void keyspace_string(const char* charset, int length, uint64_t rank, char* out);
+uint64_t keyspace_offset(int charset_len, int length);
+int keyspace_global_string(const char* charset, uint64_t global_rank, char* out);
+void keyspace_iter_init(keyspace_iter_t* iter, const char* charset, int length, uint64_t rank);
+void keyspace_iter_init_positions(keyspace_iter_t* iter, const char* const* charsets, int length, uint64_t rank);
+
+/**
+ * The hash of the current string
+ */
+static inline jhash_t keyspace_iter_hash(keyspace_iter_t* iter)
+{
+	return (jhash_t)iter->partial[0];
+}
+
+/**
+ * Steps to the next string, returning false once the keyspace wraps around
+ */
+static inline bool keyspace_iter_next(keyspace_iter_t* iter)
+{
+	int i = 0;
+	while (i < iter->length && ++iter->digits[i] == iter->radix[i]) {
+		iter->digits[i++] = 0;
+	}
+	bool wrapped = (i == iter->length);
+	if (wrapped) {
+		i--;
+	}
+	for (; i >= 0; i--) {
+		int digit = iter->digits[i];
+		iter->string[i] = iter->charsets[i][digit];
+		iter->partial[i] = iter->term[i][digit] + iter->partial[i+1];
+	}
+	return !wrapped;
+}
+
+#endif /* _JHASH_KEYSPACE_H_ */
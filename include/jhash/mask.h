@@ -0,0 +1,62 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JHASH_MASK_H_
+#define _JHASH_MASK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <jhash/keyspace.h>
+
+/**
+ * A mask gives each position of a string its own charset, eg. ?u?u?u_?d?d
+ * is three uppercase letters, an underscore and two digits. Classes are:
+ *   ?u  A-Z
+ *   ?l  a-z
+ *   ?d  0-9
+ *   ?s  the separators " _-."
+ *   ?a  ?u?l?d?s
+ *   ?c  the table charset (standard, or extended with -e)
+ *   ?1  to ?4, a custom charset, which may itself contain classes
+ *   ??  a literal ?
+ * Any other character is a literal. A mask is enumerated in the same order
+ * as a keyspace, the first position varying fastest.
+ */
+
+#define MASK_MAX_CUSTOM 4
+#define MASK_MAX_CHARSET 255
+
+typedef struct mask mask_t;
+
+/**
+ * positions[i] points at the charset for position i, either into charsets
+ * or at an existing charset, so a mask mustn't be copied by value
+ */
+struct mask {
+	int length;
+	const char* positions[KEYSPACE_MAX_LENGTH];
+	char charsets[KEYSPACE_MAX_LENGTH][MASK_MAX_CHARSET+1];
+};
+
+bool mask_parse(mask_t* mask, const char* spec, char* const* custom, const char* charset);
+void mask_from_charset(mask_t* mask, const char* charset, int length);
+uint64_t mask_size(const mask_t* mask);
+void mask_string(const mask_t* mask, uint64_t rank, char* out);
+uint32_t mask_fingerprint(const mask_t* mask);
+void mask_iter_init(keyspace_iter_t* iter, const mask_t* mask, uint64_t rank);
+
+#endif /* _JHASH_MASK_H_ */
@@ -0,0 +1,32 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JHASH_RAINBOW_H_
+#define _JHASH_RAINBOW_H_
+
+#include <jhash/args.h>
+#include <jhash/table.h>
+#include <jhash/crack.h>
+
+#define RAINBOW_BLOCK_SIZE 256 /* chains claimed by a worker at a time */
+#define RAINBOW_DEFAULT_CHAIN_LEN 1000
+#define RAINBOW_DEFAULT_CHAINS (1 << 20)
+
+void rainbow_generate(jhash_args_t* args);
+void rainbow_lookup(table_map_t* map, jhash_t hash, crack_match_t match, void* data);
+
+#endif /* _JHASH_RAINBOW_H_ */
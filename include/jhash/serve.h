@@ -0,0 +1,28 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JHASH_SERVE_H_
+#define _JHASH_SERVE_H_
+
+#include <jhash/args.h>
+
+#define SERVE_BACKLOG 64
+
+void serve_tables(jhash_args_t* args);
+void query_server(jhash_args_t* args);
+
+#endif /* _JHASH_SERVE_H_ */
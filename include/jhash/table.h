@@ -0,0 +1,115 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JHASH_TABLE_H_
+#define _JHASH_TABLE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <runite/hash.h>
+
+#define TABLE_MAGIC 0x4254484a /* "JHTB" */
+#define TABLE_VERSION 1
+
+#define TABLE_FORMAT_LEGACY 0 /* headerless, unsorted stream of table_entry_t */
+#define TABLE_FORMAT_SORTED 1 /* header, bucket directory, entries sorted by hash */
+#define TABLE_FORMAT_COMPACT 2 /* header, bucket directory, sorted table_record_t */
+#define TABLE_FORMAT_HASHES 3 /* header, one hash per string in enumeration order */
+#define TABLE_FORMAT_RAINBOW 4 /* header, chain length, table_chain_t sorted by end */
+
+#define TABLE_MAX_BUCKET_BITS 24
+#define TABLE_BUCKET_TARGET 256 /* average entries per bucket we aim for */
+
+typedef struct table_entry table_entry_t;
+typedef struct table_header table_header_t;
+typedef struct table_chain table_chain_t;
+typedef struct table_map table_map_t;
+
+struct table_entry {
+	jhash_t hash;
+	char string[16];
+};
+
+/**
+ * Compact tables store strings by their global rank: their index in the
+ * enumeration order over every length from 1 to max_len. A record packs the
+ * low (32 - bucket_bits) bits of the hash above the rank, the top bits being
+ * implied by the bucket, so records sort in (hash, rank) order.
+ */
+typedef uint64_t table_record_t;
+
+/**
+ * Rainbow tables store only the global ranks of the first and last string
+ * of each chain, see rainbow.c
+ */
+struct table_chain {
+	uint64_t start;
+	uint64_t end;
+};
+
+/**
+ * Sorted and compact tables begin with this header, followed by a directory
+ * of (1 << bucket_bits) + 1 entry indices, followed by the entries
+ * themselves. Bucket b holds the entries [directory[b], directory[b+1])
+ * whose hash has b as its top bucket_bits bits. Hash only tables have no
+ * directory, the header is followed directly by the hashes. Rainbow tables
+ * have no directory either, the header is followed by the chain length and
+ * then the chains.
+ */
+struct table_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t bucket_bits;
+	uint64_t num_entries;
+	uint32_t min_len;
+	uint32_t max_len;
+	char charset[128];
+};
+
+/**
+ * A table mapped read only into memory, so entries can be read in place
+ */
+struct table_map {
+	int fd;
+	uint8_t* data;
+	uint64_t size;
+	table_header_t header; /* header.format is TABLE_FORMAT_LEGACY for headerless tables */
+	const uint64_t* directory;
+	const table_entry_t* entries;
+	const table_record_t* records;
+	const uint32_t* hashes;
+	const table_chain_t* chains;
+	uint64_t chain_len;
+	uint64_t num_entries;
+};
+
+bool table_map_open(table_map_t* map, const char* path);
+void table_map_advise(table_map_t* map, int advice);
+void table_map_close(table_map_t* map);
+void table_header_init(table_header_t* header, int format, uint64_t num_entries, const char* charset, int max_len);
+uint64_t table_directory_offset(uint32_t bucket);
+uint64_t table_entry_offset(table_header_t* header, uint64_t entry);
+uint32_t table_record_rank_bits(uint32_t bucket_bits);
+uint32_t table_bucket(jhash_t hash, uint32_t bucket_bits);
+uint32_t table_choose_bucket_bits(uint64_t num_entries);
+bool table_sort_file(const char* in_path, const char* out_path, const char* charset, int max_len, unsigned int heap_mb);
+bool table_merge_sorted(char** in_paths, int num_inputs, const char* out_path, unsigned int heap_mb);
+bool table_sort_compact(const char* in_path, const char* out_path, unsigned int heap_mb);
+bool table_unpack_compact(const char* in_path, const char* out_path, unsigned int heap_mb);
+
+#endif /* _JHASH_TABLE_H_ */
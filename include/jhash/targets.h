@@ -0,0 +1,112 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#ifndef _JHASH_TARGETS_H_
+#define _JHASH_TARGETS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <runite/hash.h>
+
+#define TARGET_NONE SIZE_MAX
+#define TARGET_BLOOM_BLOCK_WORDS 8 /* a 64 byte cache line of bits */
+#define TARGET_BLOOM_BLOCK_BITS (TARGET_BLOOM_BLOCK_WORDS*64)
+#define TARGET_BLOOM_MAX_HASHES 7 /* each takes 9 bits of a 64 bit product */
+
+typedef struct target_set target_set_t;
+
+/**
+ * An open addressing (linear probing) set of hashes being cracked. Zero marks
+ * an empty slot, so a target of zero is tracked separately in the last slot.
+ * Each slot also records whether its target has been found.
+ *
+ * The set can have a blocked bloom filter in front of it, so that the hashes
+ * which aren't targets (almost all of them) are usually turned away by one
+ * cache line which stays resident, rather than a probe of the whole set.
+ */
+struct target_set {
+	uint32_t* slots;
+	bool* found;
+	uint32_t mask;
+	uint32_t shift;
+	bool has_zero;
+	jhash_t* targets; /* in the order they were added */
+	size_t count;
+	size_t capacity;
+	uint64_t* bloom; /* NULL without a filter */
+	uint64_t bloom_mask; /* the number of blocks, less one */
+	int bloom_hashes;
+};
+
+void target_set_init(target_set_t* set);
+void target_set_free(target_set_t* set);
+bool target_set_add(target_set_t* set, jhash_t hash);
+bool target_set_load(target_set_t* set, FILE* fd, int ident_mode);
+void target_set_build_filter(target_set_t* set, double fp_rate, size_t max_bytes);
+double target_set_filter_rate(target_set_t* set);
+
+/**
+ * Whether the filter might hold a hash. The hash picks a block, and then
+ * bloom_hashes bits within it which must all be set. The bits are tested
+ * without branching, as a miss could fail on any of them.
+ */
+static inline bool target_set_filter(target_set_t* set, jhash_t hash)
+{
+	uint64_t key = (uint32_t)hash;
+	const uint64_t* block = &set->bloom[(((key*0x9e3779b97f4a7c15ULL) >> 32) & set->bloom_mask)*TARGET_BLOOM_BLOCK_WORDS];
+	uint64_t bits = key*0xc2b2ae3d27d4eb4fULL;
+	uint64_t all_set = 1;
+	for (int i = 0; i < set->bloom_hashes; i++, bits <<= 9) {
+		uint32_t bit = bits >> 55;
+		all_set &= block[bit >> 6] >> (bit & 63);
+	}
+	return all_set;
+}
+
+/**
+ * The slot holding a target, or TARGET_NONE if it isn't one
+ */
+static inline size_t target_set_find(target_set_t* set, jhash_t hash)
+{
+	uint32_t key = (uint32_t)hash;
+	if (key == 0) {
+		return set->has_zero ? set->mask+1 : TARGET_NONE;
+	}
+	uint32_t slot = (key*0x9e3779b1) >> set->shift;
+	while (set->slots[slot] != 0) {
+		if (set->slots[slot] == key) {
+			return slot;
+		}
+		slot = (slot + 1) & set->mask;
+	}
+	return TARGET_NONE;
+}
+
+/**
+ * Whether a hash is a target, checking the filter first if there is one
+ */
+static inline bool target_set_contains(target_set_t* set, jhash_t hash)
+{
+	if (set->bloom != NULL && !target_set_filter(set, hash)) {
+		return false;
+	}
+	return target_set_find(set, hash) != TARGET_NONE;
+}
+
+#endif /* _JHASH_TARGETS_H_ */
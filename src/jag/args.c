@@ -24,16 +24,21 @@
 #include <error.h>
 #include <sys/stat.h>
 #include <runite/file.h>
+#include <jag/container.h>
 
 #define GROUP_OTHERS -1
 
 #define OPTION_EXTRACT 'x'
 #define OPTION_LIST 'l'
 #define OPTION_CREATE 'c'
+#define OPTION_BENCHMARK 'b'
 #define OPTION_VERBOSE 'v'
 #define OPTION_DECIMAL 'd'
 #define OPTION_HEXADECIMAL 'h'
 #define OPTION_STRING 's'
+#define OPTION_THREADS 't'
+#define OPTION_WHOLE 'w'
+#define OPTION_HEAP_SIZE 1
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state);
 
@@ -43,18 +48,33 @@ static char const doc[] = "Operates on archives in the jagex bz2 container forma
 \n\
 Examples:\n\
   jag -c archive.jag foo bar  # Create archive.jag from files foo and bar.\n\
+  jag -c -t 8 archive.jag dir # Create archive.jag from a directory, compressing\n\
+                              # 8 files at a time.\n\
   jag -l archive.jag          # List all files in archive.jag.\n\
-  jag -x archive.jag          # Extract all files from archive.jag.\n";
+  jag -x archive.jag          # Extract all files from archive.jag.\n\
+  jag -x archive.jag 1b2c 3d4e\n\
+                              # Extract only the files 1b2c and 3d4e.\n\
+  jag -x -s archive.jag title.dat\n\
+                              # Extract only the file named title.dat.\n\
+  jag -x -t 8 --heap-size 64 archive.jag\n\
+                              # Extract on 8 threads, holding at most 64MB of\n\
+                              # decompressed files at once.\n\
+  jag -c -w archive.jag dir   # Create archive.jag compressed as a whole.\n\
+  jag -b -t 8 archive.jag     # Benchmark decompressing it on 8 threads.\n";
 
 const struct argp_option options[] = {
 	{ 0, 0, 0, 0, "Main operation mode:\n" },
 	{ "extract", OPTION_EXTRACT, 0, 0, "Extract a given archive" },
 	{ "list", OPTION_LIST, 0, 0, "List the contents of a given archive" },
 	{ "create", OPTION_CREATE, 0, 0, "Create an archive from the given input files" },
+	{ "benchmark", OPTION_BENCHMARK, 0, 0, "Benchmark decompressing an archive compressed as a whole" },
 	{ 0, 0, 0, 0, "Operation modifiers:\n" },
 	{ "decimal", OPTION_DECIMAL, 0, 0, "Treat identifiers as decimal" },
 	{ "hex", OPTION_HEXADECIMAL, 0, 0, "Treat identifiers as hexadecimal" },
 	{ "string", OPTION_STRING, 0, 0, "Treat identifiers as hexadecimal" },
+	{ "whole", OPTION_WHOLE, 0, 0, "Compress the archive as a whole rather than file by file" },
+	{ "threads", OPTION_THREADS, "count", 0, "Set the number of worker threads" },
+	{ "heap-size", OPTION_HEAP_SIZE, "megabytes", 0, "Set the most decompressed data held at once while extracting" },
 	{ 0, 0, 0, 0, "Other options:", GROUP_OTHERS },
 	{ "verbose", OPTION_VERBOSE, 0, 0, "Enable verbose output", GROUP_OTHERS },
 	{ 0 }
@@ -63,7 +83,7 @@ const struct argp_option options[] = {
 const struct argp parser = {
 	.options = options,
 	.parser = parse_opt,
-	.args_doc = "[ARCHIVE] [FILE]...",
+	.args_doc = "[ARCHIVE] [FILE]...\n-x [ARCHIVE] [IDENTIFIER]...",
 	.doc = doc,
 	.children = NULL,
 	.help_filter = NULL,
@@ -126,6 +146,12 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 	case OPTION_CREATE:
 		new_mode = MODE_CREATE;
 		break;
+	case OPTION_BENCHMARK:
+		new_mode = MODE_BENCHMARK;
+		break;
+	case OPTION_WHOLE:
+		jag_args->whole = true;
+		break;
 	case OPTION_DECIMAL:
 		jag_args->ident_mode = IDENT_DECIMAL;
 		break;
@@ -135,6 +161,18 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 	case OPTION_STRING:
 		jag_args->ident_mode = IDENT_STRING;
 		break;
+	case OPTION_THREADS:
+		jag_args->threads = strtol(arg, NULL, 10);
+		if (jag_args->threads < 1 || jag_args->threads > CONTAINER_MAX_THREADS) {
+			print_error("invalid thread count specified", EXIT_FAILURE);
+		}
+		break;
+	case OPTION_HEAP_SIZE:
+		jag_args->heap_mb = strtoul(arg, NULL, 10);
+		if (jag_args->heap_mb == 0) {
+			print_error("invalid heap size specified", EXIT_FAILURE);
+		}
+		break;
 	case OPTION_VERBOSE:
 		jag_args->verbose = true;
 		break;
@@ -203,7 +241,7 @@ bool resolve_input_files(jag_args_t* args)
 			struct stat fstat;
 			if (stat(file->path, &fstat) != 0) {
 				char message[255];
-				sprintf(message, "%s: Cannot stat", file->path);
+				sprintf(message, "%.200s: Cannot stat", file->path);
 				print_error(message, EXIT_FAILURE);
 				return false;
 			}
@@ -0,0 +1,278 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jag/bunzip.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <bzlib.h>
+#include <jag/container.h>
+
+#define BUNZIP_INITIAL_OUTPUT (1 << 17)
+
+typedef struct bunzip_block bunzip_block_t;
+typedef struct bunzip_pool bunzip_pool_t;
+
+/**
+ * A block of the stream, from the bit its magic starts at up to the next
+ * block's magic (or the end of stream magic), and what it decoded to
+ */
+struct bunzip_block {
+	uint64_t start;
+	uint64_t end;
+	uint32_t crc;
+	uint8_t* data;
+	size_t length;
+	bool success;
+};
+
+/**
+ * The blocks shared between the workers, which take the next one until
+ * there are none left
+ */
+struct bunzip_pool {
+	const uint8_t* in;
+	bunzip_block_t* blocks;
+	int num_blocks;
+	int next;
+};
+
+/**
+ * Reads count (at most 32) bits starting at a bit offset, most significant first
+ */
+static uint32_t bunzip_read_bits(const uint8_t* data, uint64_t bit, int count)
+{
+	uint64_t value = 0;
+	size_t byte = bit >> 3;
+	int available = 8 - (bit & 7);
+	value = data[byte] & ((1 << available) - 1);
+	while (available < count) {
+		value = (value << 8) | data[++byte];
+		available += 8;
+	}
+	return (uint32_t)(value >> (available - count));
+}
+
+/**
+ * Appends count (at most 32) bits to a buffer, most significant first.
+ * The buffer must be zeroed beyond *bits.
+ */
+static void bunzip_write_bits(uint8_t* data, uint64_t* bits, uint32_t value, int count)
+{
+	for (int i = count-1; i >= 0; i--, (*bits)++) {
+		data[*bits >> 3] |= ((value >> i) & 1) << (7 - (*bits & 7));
+	}
+}
+
+/**
+ * Finds the blocks of a stream by their magic, which can be at any bit
+ * alignment. Whatever the alignment, the third byte of a magic is a whole
+ * byte of the stream, so only the positions where that byte matches are
+ * checked in full. Returns the number of blocks, or -1 if the stream has
+ * no end.
+ */
+static int bunzip_scan(const uint8_t* in, size_t in_length, bunzip_block_t** blocks)
+{
+	/* the alignments each byte value could be the third byte of a magic at,
+	 * in the low byte for a block and the high byte for the end of stream */
+	uint16_t alignments[256];
+	memset(alignments, 0, sizeof(alignments));
+	for (int alignment = 0; alignment < 8; alignment++) {
+		alignments[(BUNZIP_BLOCK_MAGIC >> (24 + alignment)) & 0xff] |= 1 << alignment;
+		alignments[(BUNZIP_END_MAGIC >> (24 + alignment)) & 0xff] |= 0x100 << alignment;
+	}
+
+	int num_blocks = 0;
+	int capacity = 16;
+	*blocks = (bunzip_block_t*)malloc(capacity*sizeof(bunzip_block_t));
+	for (size_t byte = 2; byte < in_length && *blocks != NULL; byte++) {
+		uint16_t possible = alignments[in[byte]];
+		for (int alignment = 0; possible != 0 && alignment < 8; alignment++) {
+			if (!(possible & (0x101 << alignment))) {
+				continue;
+			}
+			uint64_t start = (byte-2)*8 + alignment;
+			if (start + BUNZIP_MAGIC_BITS > (uint64_t)in_length*8) {
+				continue;
+			}
+			uint64_t candidate = ((uint64_t)bunzip_read_bits(in, start, 24) << 24) | bunzip_read_bits(in, start + 24, 24);
+			if (candidate != BUNZIP_BLOCK_MAGIC && candidate != BUNZIP_END_MAGIC) {
+				continue;
+			}
+			if (num_blocks > 0) {
+				(*blocks)[num_blocks-1].end = start;
+			}
+			if (candidate == BUNZIP_END_MAGIC) {
+				return num_blocks;
+			}
+			if (num_blocks == capacity) {
+				capacity *= 2;
+				bunzip_block_t* grown = (bunzip_block_t*)realloc(*blocks, capacity*sizeof(bunzip_block_t));
+				if (!grown) {
+					return -1;
+				}
+				*blocks = grown;
+			}
+			memset(&(*blocks)[num_blocks], 0, sizeof(bunzip_block_t));
+			(*blocks)[num_blocks++].start = start;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Decodes one block, by rewrapping it as a stream of its own (as
+ * bzip2recover does): the header, the block, and an end of stream whose
+ * combined CRC is just the block's CRC
+ */
+static bool bunzip_decode_block(const uint8_t* in, bunzip_block_t* block)
+{
+	uint64_t block_bits = block->end - block->start;
+	if (block_bits < BUNZIP_MAGIC_BITS + 32) {
+		return false;
+	}
+	block->crc = bunzip_read_bits(in, block->start + BUNZIP_MAGIC_BITS, 32);
+
+	size_t header_length = strlen(CONTAINER_BZIP2_HEADER);
+	size_t stream_length = header_length + (block_bits + BUNZIP_MAGIC_BITS + 32 + 7)/8;
+	uint8_t* stream = (uint8_t*)calloc(stream_length, 1);
+	if (!stream) {
+		return false;
+	}
+	memcpy(stream, CONTAINER_BZIP2_HEADER, header_length);
+
+	/* shift the whole bytes of the block into alignment, then the bits left over */
+	uint64_t whole_bytes = block_bits/8;
+	const uint8_t* source = &in[block->start/8];
+	int shift = block->start & 7;
+	uint8_t* dest = &stream[header_length];
+	if (shift == 0) {
+		memcpy(dest, source, whole_bytes);
+	} else {
+		for (uint64_t i = 0; i < whole_bytes; i++) {
+			dest[i] = (source[i] << shift) | (source[i+1] >> (8 - shift));
+		}
+	}
+	uint64_t bits = (header_length + whole_bytes)*8;
+	int remaining = block_bits & 7;
+	bunzip_write_bits(stream, &bits, bunzip_read_bits(in, block->end - remaining, remaining), remaining);
+	bunzip_write_bits(stream, &bits, BUNZIP_END_MAGIC >> 24, 24);
+	bunzip_write_bits(stream, &bits, BUNZIP_END_MAGIC & 0xffffff, 24);
+	bunzip_write_bits(stream, &bits, block->crc, 32);
+
+	/* the decoded size isn't known, so grow the output as it's decoded */
+	bz_stream bz;
+	memset(&bz, 0, sizeof(bz_stream));
+	size_t capacity = BUNZIP_INITIAL_OUTPUT;
+	block->data = (uint8_t*)malloc(capacity);
+	bool success = (block->data != NULL) && BZ2_bzDecompressInit(&bz, 0, 0) == BZ_OK;
+	bz.next_in = (char*)stream;
+	bz.avail_in = stream_length;
+	int result = BZ_OK;
+	while (success && result == BZ_OK) {
+		if (block->length == capacity) {
+			uint8_t* grown = (uint8_t*)realloc(block->data, capacity*2);
+			if (!grown) {
+				success = false;
+				break;
+			}
+			block->data = grown;
+			capacity *= 2;
+		}
+		bz.next_out = (char*)&block->data[block->length];
+		bz.avail_out = capacity - block->length;
+		result = BZ2_bzDecompress(&bz);
+		block->length = capacity - bz.avail_out;
+
+		/* out of input without reaching the end means the block was cut short */
+		success = (result == BZ_STREAM_END) || (result == BZ_OK && (bz.avail_in > 0 || bz.avail_out == 0));
+	}
+	if (block->data != NULL) {
+		BZ2_bzDecompressEnd(&bz);
+	}
+	free(stream);
+	return success;
+}
+
+/**
+ * Worker thread entry point, decodes blocks until there are none left
+ */
+static void* bunzip_run(void* data)
+{
+	bunzip_pool_t* pool = (bunzip_pool_t*)data;
+	int i;
+	while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->num_blocks) {
+		pool->blocks[i].success = bunzip_decode_block(pool->in, &pool->blocks[i]);
+	}
+	return NULL;
+}
+
+/**
+ * Decompresses exactly out_length bytes of bzip2 data which has had its
+ * header stripped, the same as container_bunzip but with the stream's
+ * blocks decoded on num_threads threads, in the manner of lbzip2. Each
+ * block checks its own CRC, and the blocks' CRCs are checked against the
+ * stream's combined CRC. A magic number can turn up by chance within
+ * compressed data, so if the blocks don't add up the stream is decoded
+ * serially instead.
+ */
+bool bunzip_parallel(const uint8_t* in, size_t in_length, uint8_t* out, size_t out_length, int num_threads)
+{
+	bunzip_pool_t pool;
+	pool.in = in;
+	pool.next = 0;
+	pool.num_blocks = bunzip_scan(in, in_length, &pool.blocks);
+
+	bool success = (pool.num_blocks > 0);
+	if (success) {
+		/* the calling thread takes blocks too */
+		pthread_t threads[BUNZIP_MAX_THREADS];
+		int num_started = 0;
+		while (num_started < num_threads-1 && num_started < pool.num_blocks-1 &&
+				pthread_create(&threads[num_started], NULL, bunzip_run, &pool) == 0) {
+			num_started++;
+		}
+		bunzip_run(&pool);
+		for (int i = 0; i < num_started; i++) {
+			pthread_join(threads[i], NULL);
+		}
+
+		/* stitch the blocks together */
+		uint64_t end = pool.blocks[pool.num_blocks-1].end;
+		success = (end + BUNZIP_MAGIC_BITS + 32 <= (uint64_t)in_length*8);
+		uint32_t stream_crc = success ? bunzip_read_bits(in, end + BUNZIP_MAGIC_BITS, 32) : 0;
+		uint32_t combined_crc = 0;
+		size_t length = 0;
+		for (int i = 0; i < pool.num_blocks && success; i++) {
+			bunzip_block_t* block = &pool.blocks[i];
+			success = block->success && length + block->length <= out_length;
+			if (success) {
+				memcpy(&out[length], block->data, block->length);
+				length += block->length;
+				combined_crc = ((combined_crc << 1) | (combined_crc >> 31)) ^ block->crc;
+			}
+		}
+		success &= (length == out_length && combined_crc == stream_crc);
+	}
+
+	for (int i = 0; i < pool.num_blocks; i++) {
+		free(pool.blocks[i].data);
+	}
+	free(pool.blocks);
+	return success || container_bunzip(in, in_length, out, out_length);
+}
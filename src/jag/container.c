@@ -0,0 +1,443 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jag/container.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <bzlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <jag/bunzip.h>
+
+typedef struct container_task container_task_t;
+typedef struct container_pool container_pool_t;
+typedef struct container_extractor container_extractor_t;
+
+/**
+ * One entry of an archive being compressed. The compressed data lives
+ * within the single entry archive it was compressed as.
+ */
+struct container_task {
+	archive_file_t* file;
+	file_t compressed;
+	const uint8_t* data;
+	uint32_t length;
+	bool success;
+};
+
+/**
+ * The entries shared between the workers, which take the next one until
+ * there are none left
+ */
+struct container_pool {
+	container_task_t* entries;
+	int num_entries;
+	int next;
+};
+
+/**
+ * Reads a big endian 24 bit value
+ */
+uint32_t container_read24(const uint8_t* data)
+{
+	return (data[0] << 16) | (data[1] << 8) | data[2];
+}
+
+/**
+ * Writes a big endian 24 bit value
+ */
+void container_write24(uint8_t* data, uint32_t value)
+{
+	data[0] = value >> 16;
+	data[1] = value >> 8;
+	data[2] = value;
+}
+
+/**
+ * Compresses one entry, as an archive of its own. The entry compresses the
+ * same whichever archive it's in, so its data can be lifted straight out.
+ */
+static bool container_compress_entry(container_task_t* entry)
+{
+	archive_t* single = object_new(archive);
+	bool success = archive_add_file(single, entry->file->identifier, &entry->file->file) != NULL &&
+		archive_compress(single, &entry->compressed, ARCHIVE_COMPRESS_FILE);
+	object_free(single);
+	if (!success) {
+		return false;
+	}
+
+	const uint8_t* data = entry->compressed.data;
+	size_t entries_end = CONTAINER_HEADER_SIZE + 2 + CONTAINER_ENTRY_SIZE;
+	if (entry->compressed.length < entries_end || data[CONTAINER_HEADER_SIZE] != 0 || data[CONTAINER_HEADER_SIZE+1] != 1) {
+		return false;
+	}
+	entry->length = container_read24(&data[CONTAINER_HEADER_SIZE + 2 + 7]);
+	entry->data = &data[entries_end];
+	return entries_end + entry->length <= entry->compressed.length;
+}
+
+/**
+ * Worker thread entry point, compresses entries until there are none left
+ */
+static void* container_compress_run(void* data)
+{
+	container_pool_t* pool = (container_pool_t*)data;
+	int i;
+	while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->num_entries) {
+		pool->entries[i].success = container_compress_entry(&pool->entries[i]);
+	}
+	return NULL;
+}
+
+/**
+ * Compresses an archive entry by entry, the same as archive_compress with
+ * ARCHIVE_COMPRESS_FILE, but with the entries compressed on num_threads
+ * threads. The container is then assembled in the archive's order, so the
+ * output is identical.
+ */
+bool container_compress(archive_t* archive, file_t* out, int num_threads)
+{
+	container_pool_t pool;
+	pool.num_entries = archive->num_files;
+	pool.next = 0;
+	pool.entries = (container_task_t*)calloc(pool.num_entries, sizeof(container_task_t));
+	if (!pool.entries && pool.num_entries > 0) {
+		return false;
+	}
+	archive_file_t* file;
+	int i = 0;
+	list_for_each(&archive->files) {
+		list_for_get(file);
+		pool.entries[i++].file = file;
+	}
+
+	/* the calling thread takes entries too */
+	if (num_threads > pool.num_entries) {
+		num_threads = pool.num_entries;
+	}
+	pthread_t threads[CONTAINER_MAX_THREADS];
+	int num_started = 0;
+	while (num_started < num_threads-1 && pthread_create(&threads[num_started], NULL, container_compress_run, &pool) == 0) {
+		num_started++;
+	}
+	container_compress_run(&pool);
+	for (i = 0; i < num_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	/* lay out the header, the entry table and then the data */
+	bool success = true;
+	size_t length = 2 + (size_t)pool.num_entries*CONTAINER_ENTRY_SIZE;
+	for (i = 0; i < pool.num_entries; i++) {
+		success &= pool.entries[i].success;
+		length += pool.entries[i].length;
+	}
+	out->data = success ? (uint8_t*)malloc(CONTAINER_HEADER_SIZE + length) : NULL;
+	if (out->data != NULL) {
+		uint8_t* body = &out->data[CONTAINER_HEADER_SIZE];
+		container_write24(&out->data[0], length);
+		container_write24(&out->data[3], length);
+		body[0] = pool.num_entries >> 8;
+		body[1] = pool.num_entries;
+		size_t offset = 2 + (size_t)pool.num_entries*CONTAINER_ENTRY_SIZE;
+		for (i = 0; i < pool.num_entries; i++) {
+			container_task_t* entry = &pool.entries[i];
+			uint8_t* table_entry = &body[2 + i*CONTAINER_ENTRY_SIZE];
+			table_entry[0] = entry->file->identifier >> 24;
+			table_entry[1] = entry->file->identifier >> 16;
+			table_entry[2] = entry->file->identifier >> 8;
+			table_entry[3] = entry->file->identifier;
+			container_write24(&table_entry[4], entry->file->file.length);
+			container_write24(&table_entry[7], entry->length);
+			memcpy(&body[offset], entry->data, entry->length);
+			offset += entry->length;
+		}
+		out->length = CONTAINER_HEADER_SIZE + length;
+	}
+
+	for (i = 0; i < pool.num_entries; i++) {
+		free(pool.entries[i].compressed.data);
+	}
+	free(pool.entries);
+	return out->data != NULL;
+}
+
+/**
+ * Maps a file read only, so that only the parts of it which are used are
+ * read from disk
+ */
+bool container_map(file_t* file, const char* path)
+{
+	file->data = NULL;
+	file->length = 0;
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return false;
+	}
+	file->length = st.st_size;
+	if (file->length > 0) {
+		void* data = mmap(NULL, file->length, PROT_READ, MAP_PRIVATE, fd, 0);
+		file->data = (data != MAP_FAILED) ? (uint8_t*)data : NULL;
+	}
+	close(fd);
+	return file->length == 0 || file->data != NULL;
+}
+
+/**
+ * Unmaps a file mapped with container_map
+ */
+void container_unmap(file_t* file)
+{
+	if (file->data != NULL) {
+		munmap(file->data, file->length);
+	}
+	file->data = NULL;
+	file->length = 0;
+}
+
+/**
+ * Decompresses exactly out_length bytes of bzip2 data which has had its
+ * header stripped
+ */
+bool container_bunzip(const uint8_t* in, size_t in_length, uint8_t* out, size_t out_length)
+{
+	bz_stream stream;
+	memset(&stream, 0, sizeof(bz_stream));
+	if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) {
+		return false;
+	}
+	stream.next_out = (char*)out;
+	stream.avail_out = out_length;
+
+	/* feed the header back in ahead of the data */
+	stream.next_in = CONTAINER_BZIP2_HEADER;
+	stream.avail_in = strlen(CONTAINER_BZIP2_HEADER);
+	int result = BZ2_bzDecompress(&stream);
+	if (result == BZ_OK) {
+		stream.next_in = (char*)in;
+		stream.avail_in = in_length;
+		result = BZ2_bzDecompress(&stream);
+	}
+	bool success = (result == BZ_STREAM_END && stream.avail_out == 0);
+	BZ2_bzDecompressEnd(&stream);
+	return success;
+}
+
+/**
+ * Opens a container, reading its entry table. Nothing is decompressed
+ * unless the container was compressed as a whole, in which case it's
+ * decompressed on num_threads threads.
+ */
+bool container_open(container_t* container, file_t* file, int num_threads)
+{
+	memset(container, 0, sizeof(container_t));
+	if (file->length < CONTAINER_HEADER_SIZE) {
+		return false;
+	}
+	uint32_t length = container_read24(&file->data[0]);
+	uint32_t compressed_length = container_read24(&file->data[3]);
+	if (compressed_length > file->length - CONTAINER_HEADER_SIZE) {
+		return false;
+	}
+	container->body = &file->data[CONTAINER_HEADER_SIZE];
+	container->body_length = length;
+	if (length != compressed_length) {
+		container->whole = true;
+		container->body = (uint8_t*)malloc(length);
+		bool decompressed = (container->body != NULL) && ((num_threads > 1) ?
+			bunzip_parallel(&file->data[CONTAINER_HEADER_SIZE], compressed_length, container->body, length, num_threads) :
+			container_bunzip(&file->data[CONTAINER_HEADER_SIZE], compressed_length, container->body, length));
+		if (!decompressed) {
+			container_close(container);
+			return false;
+		}
+	}
+
+	const uint8_t* body = container->body;
+	if (length < 2) {
+		container_close(container);
+		return false;
+	}
+	container->num_entries = (body[0] << 8) | body[1];
+	size_t offset = 2 + (size_t)container->num_entries*CONTAINER_ENTRY_SIZE;
+	container->entries = (container_entry_t*)calloc(container->num_entries, sizeof(container_entry_t));
+	if ((!container->entries && container->num_entries > 0) || offset > length) {
+		container_close(container);
+		return false;
+	}
+	for (int i = 0; i < container->num_entries; i++) {
+		const uint8_t* table_entry = &body[2 + i*CONTAINER_ENTRY_SIZE];
+		container_entry_t* entry = &container->entries[i];
+		entry->identifier = ((uint32_t)table_entry[0] << 24) | (table_entry[1] << 16) | (table_entry[2] << 8) | table_entry[3];
+		entry->length = container_read24(&table_entry[4]);
+		entry->compressed_length = container_read24(&table_entry[7]);
+		entry->data = &body[offset];
+		offset += container->whole ? entry->length : entry->compressed_length;
+		if (offset > length) {
+			container_close(container);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Frees what was allocated opening a container
+ */
+void container_close(container_t* container)
+{
+	if (container->whole) {
+		free(container->body);
+	}
+	free(container->entries);
+	memset(container, 0, sizeof(container_t));
+}
+
+/**
+ * The state shared by the extraction workers. Entries are taken in order,
+ * and an entry's decompressed size is reserved against max_in_flight before
+ * it's decoded, and released once it's on disk.
+ */
+struct container_extractor {
+	container_t* container;
+	char** paths;
+	bool verbose;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int next;
+	size_t in_flight;
+	size_t max_in_flight;
+	bool failed;
+	char* error;
+};
+
+/**
+ * Decodes an entry if need be and writes it out
+ */
+static bool container_extract_entry(container_t* container, container_entry_t* entry, const char* path, char* error)
+{
+	const uint8_t* data = entry->data;
+	uint8_t* decoded = NULL;
+	if (!container->whole) {
+		decoded = (uint8_t*)malloc(entry->length);
+		if ((!decoded && entry->length > 0) || !container_bunzip(entry->data, entry->compressed_length, decoded, entry->length)) {
+			free(decoded);
+			sprintf(error, "%.200s: unable to decompress file", path);
+			return false;
+		}
+		data = decoded;
+	}
+
+	FILE* fd = fopen(path, "w+");
+	bool success = (fd != NULL);
+	if (!success) {
+		sprintf(error, "%.200s: unable to open file for writing", path);
+	} else {
+		success = fwrite(data, 1, entry->length, fd) == entry->length;
+		success &= (fclose(fd) == 0);
+		if (!success) {
+			sprintf(error, "%.200s: unable to write entire file", path);
+		}
+	}
+	free(decoded);
+	return success;
+}
+
+/**
+ * Worker thread entry point, extracts entries until there are none left
+ */
+static void* container_extract_run(void* data)
+{
+	container_extractor_t* extractor = (container_extractor_t*)data;
+	container_t* container = extractor->container;
+	pthread_mutex_lock(&extractor->lock);
+	while (!extractor->failed && extractor->next < container->num_entries) {
+		int i = extractor->next++;
+		if (extractor->paths[i] == NULL) {
+			continue;
+		}
+
+		/* an entry larger than the limit goes through on its own */
+		size_t length = container->entries[i].length;
+		while (extractor->in_flight > 0 && extractor->in_flight + length > extractor->max_in_flight) {
+			pthread_cond_wait(&extractor->cond, &extractor->lock);
+		}
+		extractor->in_flight += length;
+		pthread_mutex_unlock(&extractor->lock);
+
+		char error[255];
+		bool success = container_extract_entry(container, &container->entries[i], extractor->paths[i], error);
+
+		pthread_mutex_lock(&extractor->lock);
+		extractor->in_flight -= length;
+		pthread_cond_broadcast(&extractor->cond);
+		if (!success && !extractor->failed) {
+			extractor->failed = true;
+			strcpy(extractor->error, error);
+		}
+		if (success && extractor->verbose) {
+			printf("Extracted %s\n", extractor->paths[i]);
+		}
+	}
+	pthread_mutex_unlock(&extractor->lock);
+	return NULL;
+}
+
+/**
+ * Extracts the entries of a container to paths, skipping those with a NULL
+ * path, on num_threads threads. Entries are decoded and written by the same
+ * worker, so one entry is written while others are decoded, and at most
+ * max_in_flight decompressed bytes are held at once. On failure, error
+ * holds a message describing the first failure.
+ */
+bool container_extract(container_t* container, char** paths, int num_threads, size_t max_in_flight, bool verbose, char* error)
+{
+	container_extractor_t extractor;
+	memset(&extractor, 0, sizeof(container_extractor_t));
+	extractor.container = container;
+	extractor.paths = paths;
+	extractor.verbose = verbose;
+	extractor.max_in_flight = container->whole ? SIZE_MAX : max_in_flight; /* already in memory */
+	extractor.error = error;
+	pthread_mutex_init(&extractor.lock, NULL);
+	pthread_cond_init(&extractor.cond, NULL);
+
+	/* the calling thread takes entries too */
+	pthread_t threads[CONTAINER_MAX_THREADS];
+	int num_started = 0;
+	while (num_started < num_threads-1 && pthread_create(&threads[num_started], NULL, container_extract_run, &extractor) == 0) {
+		num_started++;
+	}
+	container_extract_run(&extractor);
+	for (int i = 0; i < num_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&extractor.lock);
+	pthread_cond_destroy(&extractor.cond);
+	return !extractor.failed;
+}
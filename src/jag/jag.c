@@ -23,10 +23,13 @@
 #include <errno.h>
 #include <sys/stat.h>
 #include <libgen.h>
+#include <time.h>
 #include <runite/archive.h>
 #include <runite/file.h>
 
 #include <jag/args.h>
+#include <jag/container.h>
+#include <jag/bunzip.h>
 
 char* program_name;
 extern char* program_invocation_name;
@@ -35,12 +38,16 @@ jag_args_t jag_args = {
 	.mode = MODE_NONE,
 	.archive = "",
 	.verbose = false,
-	.ident_mode = IDENT_HEXADECIMAL
+	.ident_mode = IDENT_HEXADECIMAL,
+	.whole = false,
+	.threads = 1,
+	.heap_mb = 256
 };
 
-static void jag_extract(char* archive_path);
+static void jag_extract(char* archive_path, list_t* selection);
 static void jag_list(char* archive_path);
 static void jag_create(char* archive_path, list_t* input_files);
+static void jag_benchmark(char* archive_path);
 static void jag_exit();
 
 /**
@@ -85,7 +92,7 @@ int main(int argc, char** argv)
 		print_error("no archive specified", EXIT_FAILURE);
 	}
 
-	if ((jag_args.mode == MODE_EXTRACT || jag_args.mode == MODE_LIST) && num_inputs > 0) {
+	if ((jag_args.mode == MODE_LIST || jag_args.mode == MODE_BENCHMARK) && num_inputs > 0) {
 		print_error("unnecessary input files specified", EXIT_FAILURE);
 	}
 
@@ -93,15 +100,16 @@ int main(int argc, char** argv)
 		print_error("no input files specified", EXIT_FAILURE);
 	}
 
-	if (!resolve_input_files(&jag_args)) {
+	/* when extracting, the inputs select the files to extract */
+	if (jag_args.mode == MODE_CREATE && !resolve_input_files(&jag_args)) {
 		print_error("unable to resolve input files", EXIT_FAILURE);
 	}
 
-	if (jag_args.mode == MODE_EXTRACT || jag_args.mode == MODE_LIST) {
+	if (jag_args.mode == MODE_EXTRACT || jag_args.mode == MODE_LIST || jag_args.mode == MODE_BENCHMARK) {
 		struct stat fstat;
 		if (stat(jag_args.archive, &fstat) != 0) {
 			char message[255];
-			sprintf(message, "%s: Cannot stat", jag_args.archive);
+			sprintf(message, "%.200s: Cannot stat", jag_args.archive);
 			print_error(message, EXIT_FAILURE);
 		}
 	}
@@ -109,7 +117,7 @@ int main(int argc, char** argv)
 	/* do the work.. */
 	switch (jag_args.mode) {
 	case MODE_EXTRACT:
-		jag_extract(jag_args.archive);
+		jag_extract(jag_args.archive, &jag_args.input_files);
 		break;
 	case MODE_LIST:
 		jag_list(jag_args.archive);
@@ -117,11 +125,18 @@ int main(int argc, char** argv)
 	case MODE_CREATE:
 		jag_create(jag_args.archive, &jag_args.input_files);
 		break;
+	case MODE_BENCHMARK:
+		jag_benchmark(jag_args.archive);
+		break;
 	}
 
 	return EXIT_SUCCESS;
 }
 
+/**
+ * Formats an identifier for output. Names can't be recovered from their
+ * hashes, so with --string identifiers are formatted as hexadecimal.
+ */
 static void format_identifier(jhash_t identifier, char* out)
 {
 	switch (jag_args.ident_mode) {
@@ -129,15 +144,35 @@ static void format_identifier(jhash_t identifier, char* out)
 		sprintf(out, "%i", identifier);
 		break;
 	case IDENT_HEXADECIMAL:
+	case IDENT_STRING:
 		sprintf(out, "%x", identifier);
 		break;
 	}
 }
 
 /**
- * Extracts the contents of an archive
+ * Parses an identifier, or hashes a name with --string
+ */
+static jhash_t parse_identifier(const char* name)
+{
+	switch (jag_args.ident_mode) {
+	case IDENT_DECIMAL:
+		return strtol(name, NULL, 10);
+	case IDENT_HEXADECIMAL:
+		return strtol(name, NULL, 16);
+	case IDENT_STRING:
+		return jagex_hash(name);
+	}
+	return 0;
+}
+
+/**
+ * Extracts the contents of an archive, or only the files selected. The
+ * archive is mapped rather than read, so that files which aren't selected
+ * are neither read nor decompressed (unless the archive was compressed as
+ * a whole).
  */
-static void jag_extract(char* archive_path)
+static void jag_extract(char* archive_path, list_t* selection)
 {
 	/* create the destination directory */
 	char dir_name[255];
@@ -151,86 +186,110 @@ static void jag_extract(char* archive_path)
 		print_error("unable to create destination directory", EXIT_FAILURE);
 	}
 
-	/* decompress the archive */
+	/* read the entry table */
 	file_t archive_file;
-	if (!file_read(&archive_file, archive_path)) {
+	if (!container_map(&archive_file, archive_path)) {
 		printf("%s\n", archive_path);
 		print_error("unable to read archive", EXIT_FAILURE);
 	}
-	archive_t* archive = object_new(archive);
-	if (!archive_decompress(archive, &archive_file)) {
-		object_free(archive);
-		free(archive_file.data);
+	container_t container;
+	if (!container_open(&container, &archive_file, jag_args.threads)) {
+		container_unmap(&archive_file);
 		print_error("unable to decompress archive", EXIT_FAILURE);
 	}
-	free(archive_file.data);
 
-	/* extract the contents to disk */
-	archive_file_t* file;
-	list_for_each(&archive->files) {
-		list_for_get(file);
+	/* pick out the files to extract, named as they were selected */
+	char (*file_paths)[255] = malloc(container.num_entries*sizeof(*file_paths));
+	char** paths = (char**)malloc(container.num_entries*sizeof(char*));
+	if (container.num_entries > 0 && (!file_paths || !paths)) {
+		print_error("unable to allocate file paths", EXIT_FAILURE);
+	}
+	bool extract_all = (list_count(selection) == 0);
+	for (int i = 0; i < container.num_entries; i++) {
 		char file_name[255];
-		char file_path[255];
-		format_identifier(file->identifier, file_name);
-		file_path_join(dir_name, file_name, file_path);
-		
-		/* write the file */
-		FILE* fd = fopen(file_path, "w+");
-		if (fd == NULL) {
-			char message[255];
-			sprintf(message, "%s: unable to open file for writing", file_path);
+		format_identifier(container.entries[i].identifier, file_name);
+		file_path_join(dir_name, file_name, file_paths[i]);
+		paths[i] = extract_all ? file_paths[i] : NULL;
+	}
+	input_file_t* selected;
+	list_for_each(selection) {
+		list_for_get(selected);
+		jhash_t identifier = parse_identifier(selected->path);
+		int i = 0;
+		while (i < container.num_entries && container.entries[i].identifier != identifier) {
+			i++;
+		}
+		if (i == container.num_entries) {
+			char message[300];
+			sprintf(message, "%.200s: not found in archive", selected->path);
+			errno = 0;
 			print_error(message, EXIT_FAILURE);
 		}
-		size_t written = fwrite(file->file.data, 1, file->file.length, fd);
-		fclose(fd);
-		if (written != file->file.length) {
-			char message[255];
-			sprintf(message, "%s: unable to write entire file", file_path);
-			print_error(message, EXIT_FAILURE);			
+		if (jag_args.ident_mode == IDENT_STRING) {
+			file_path_join(dir_name, basename(selected->path), file_paths[i]);
 		}
+		paths[i] = file_paths[i];
+	}
 
-		if (jag_args.verbose) {
-			printf("Extracted %s\n", file_path);
-		}
+	/* decompress and write out the contents, spread over threads */
+	char message[255];
+	if (!container_extract(&container, paths, jag_args.threads, (size_t)jag_args.heap_mb*1024*1024, jag_args.verbose, message)) {
+		print_error(message, EXIT_FAILURE);
 	}
 
-	object_free(archive);	
+	free(paths);
+	free(file_paths);
+	container_close(&container);
+	container_unmap(&archive_file);
 }
 
 /**
- * Lists the contents of an archive
+ * Lists the contents of an archive, with the sizes and compression ratio
+ * of each file. Only the entry table is read, unless the archive was
+ * compressed as a whole, in which case its files have no sizes of their
+ * own and only the total is compressed.
  */
 static void jag_list(char* archive_path)
 {
 	file_t archive_file;
-	if (!file_read(&archive_file, archive_path)) {
+	if (!container_map(&archive_file, archive_path)) {
 		print_error("unable to read archive", EXIT_FAILURE);
 	}
-	archive_t* archive = object_new(archive);
-	if (!archive_decompress(archive, &archive_file)) {
-		object_free(archive);
-		free(archive_file.data);
+	container_t container;
+	if (!container_open(&container, &archive_file, jag_args.threads)) {
+		container_unmap(&archive_file);
 		print_error("unable to decompress archive", EXIT_FAILURE);
 	}
-	free(archive_file.data);
 
 	if (jag_args.verbose) {
-		printf("Identifier\tSize\n");
+		printf("Identifier\tSize\tPacked\tRatio\n");
 	}
 
-	archive_file_t* file;
-	list_for_each(&archive->files) {
-		list_for_get(file);
+	uint64_t total_size = 0;
+	for (int i = 0; i < container.num_entries; i++) {
+		container_entry_t* entry = &container.entries[i];
 		char fmt_identifier[20];
-		format_identifier(file->identifier, fmt_identifier);
-		printf("%-11s\t%zu\n", fmt_identifier, file->file.length);
+		format_identifier(entry->identifier, fmt_identifier);
+		total_size += entry->length;
+		if (container.whole) {
+			printf("%-11s\t%u\t-\t-\n", fmt_identifier, entry->length);
+		} else if (entry->length == 0) {
+			printf("%-11s\t%u\t%u\t-\n", fmt_identifier, entry->length, entry->compressed_length);
+		} else {
+			printf("%-11s\t%u\t%u\t%.1f%%\n", fmt_identifier, entry->length, entry->compressed_length,
+				100.0*entry->compressed_length/entry->length);
+		}
 	}
-	
+
 	if (jag_args.verbose) {
-		printf("%d files\n", archive->num_files);
+		uint64_t packed_size = archive_file.length;
+		printf("%d files, %lu bytes, %lu packed (%.1f%%)%s\n", container.num_entries, (unsigned long)total_size,
+			(unsigned long)packed_size, total_size ? 100.0*packed_size/total_size : 0.0,
+			container.whole ? ", compressed as a whole" : "");
 	}
 
-	object_free(archive);
+	container_close(&container);
+	container_unmap(&archive_file);
 }
 
 /**
@@ -244,39 +303,28 @@ static void jag_create(char* archive_path, list_t* input_files)
 		list_for_get(in_file);
 
 		/* figure out the identifier */
-		jhash_t identifier = 0;
 		char file_name[255];
 		strcpy(file_name, basename(in_file->path));
-		switch (jag_args.ident_mode) {
-		case IDENT_DECIMAL:
-			identifier = strtol(file_name, NULL, 10);
-			break;
-		case IDENT_HEXADECIMAL:
-			identifier = strtol(file_name, NULL, 16);
-			break;
-		case IDENT_STRING:
-			identifier = jagex_hash(file_name);
-			break;
-		}
+		jhash_t identifier = parse_identifier(file_name);
 		if (identifier == 0) {
-			char message[100];
-			sprintf(message, "%s: unable to determine identifier", in_file->path);
+			char message[255];
+			sprintf(message, "%.200s: unable to determine identifier", in_file->path);
 			print_error(message, EXIT_FAILURE);
 		}
 
 		/* read the file from disk */
 		file_t file;
 		if (!file_read(&file, in_file->path)) {
-			char message[100];
-			sprintf(message, "%s: unable to read", in_file->path);
+			char message[255];
+			sprintf(message, "%.200s: unable to read", in_file->path);
 			print_error(message, EXIT_FAILURE);
 		}
 
 		/* add the file to our archive */
 		archive_file_t* archive_file = archive_add_file(archive, identifier, &file);
 		if (archive_file == NULL) {
-			char message[100];
-			sprintf(message, "%s: unable add file", in_file->path); /* probably a name collision */
+			char message[255];
+			sprintf(message, "%.200s: unable add file", in_file->path); /* probably a name collision */
 			print_error(message, EXIT_FAILURE);
 		}
 
@@ -293,22 +341,88 @@ static void jag_create(char* archive_path, list_t* input_files)
 		free(file.data);
 	}
 
-	/* do the compression */
+	/* do the compression, with the entries spread over threads if we have them */
 	file_t out_file;
-	if (!archive_compress(archive, &out_file, ARCHIVE_COMPRESS_FILE)) {
+	bool compressed;
+	if (jag_args.whole) {
+		compressed = archive_compress(archive, &out_file, ARCHIVE_COMPRESS_WHOLE);
+	} else if (jag_args.threads > 1) {
+		compressed = container_compress(archive, &out_file, jag_args.threads);
+	} else {
+		compressed = archive_compress(archive, &out_file, ARCHIVE_COMPRESS_FILE);
+	}
+	if (!compressed) {
 		print_error("unable to compress archive", EXIT_FAILURE);
 	}
 
 	/* write the file out */
 	if (!file_write(&out_file, archive_path)) {
-		char message[100];
-		sprintf(message, "%s: unable to write archive", archive_path);
+		char message[255];
+		sprintf(message, "%.200s: unable to write archive", archive_path);
 		print_error(message, EXIT_FAILURE);
 	}
 
 	object_free(archive);
 }
 
+/**
+ * Seconds since some arbitrary point, for timing
+ */
+static double jag_now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec/1e9;
+}
+
+/**
+ * Benchmarks decompressing an archive compressed as a whole with libbz2
+ * on one thread, against the block parallel decoder, checking they agree
+ */
+static void jag_benchmark(char* archive_path)
+{
+	file_t archive_file;
+	if (!container_map(&archive_file, archive_path)) {
+		print_error("unable to read archive", EXIT_FAILURE);
+	}
+	uint32_t length = 0;
+	uint32_t compressed_length = 0;
+	if (archive_file.length >= CONTAINER_HEADER_SIZE) {
+		length = container_read24(&archive_file.data[0]);
+		compressed_length = container_read24(&archive_file.data[3]);
+	}
+	if (length == compressed_length || compressed_length > archive_file.length - CONTAINER_HEADER_SIZE) {
+		container_unmap(&archive_file);
+		print_error("archive isn't compressed as a whole, create one with --whole", EXIT_FAILURE);
+	}
+	const uint8_t* data = &archive_file.data[CONTAINER_HEADER_SIZE];
+	uint8_t* serial = (uint8_t*)malloc(length);
+	uint8_t* parallel = (uint8_t*)malloc(length);
+	if (!serial || !parallel) {
+		print_error("unable to allocate benchmark buffers", EXIT_FAILURE);
+	}
+	printf("decompressing %u bytes from %u:\n", length, compressed_length);
+
+	double start = jag_now();
+	bool success = container_bunzip(data, compressed_length, serial, length);
+	double seconds = jag_now() - start;
+	printf("%-24s %8.1f MB/sec (%.3fs)\n", "libbz2", length/seconds/1e6, seconds);
+
+	start = jag_now();
+	success &= bunzip_parallel(data, compressed_length, parallel, length, jag_args.threads);
+	seconds = jag_now() - start;
+	char name[32];
+	sprintf(name, "parallel, %d threads", jag_args.threads);
+	printf("%-24s %8.1f MB/sec (%.3fs)\n", name, length/seconds/1e6, seconds);
+
+	if (!success || memcmp(serial, parallel, length) != 0) {
+		print_error("parallel decoder disagrees with libbz2", EXIT_FAILURE);
+	}
+	free(parallel);
+	free(serial);
+	container_unmap(&archive_file);
+}
+
 /**
  * Called on exit
  */
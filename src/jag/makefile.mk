@@ -1,5 +1,5 @@
 JAG_OUT = $(BIN_DIR)/jag
-JAG_OBJECTS = $(addprefix src/jag/,jag.o args.o)
+JAG_OBJECTS = $(addprefix src/jag/,jag.o args.o container.o bunzip.o)
 
 TARGETS += $(JAG_OUT)
 OBJECTS += $(JAG_OBJECTS)
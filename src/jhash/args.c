@@ -22,18 +22,46 @@
 #include <string.h>
 #include <error.h>
 #include <runite/file.h>
+#include <jhash/table.h>
+#include <jhash/generate.h>
 
 #define GROUP_OTHERS -1
 
 #define OPTION_GEN_TABLE 'g'
 #define OPTION_CRACK 'c'
 #define OPTION_HASH 'h'
+#define OPTION_BENCHMARK 'b'
+#define OPTION_MITM 'm'
+#define OPTION_SERVE 'S'
+#define OPTION_QUERY 'Q'
+#define OPTION_ATTACK 'a'
 #define OPTION_VERBOSE 'v'
 #define OPTION_EXTD_CHARSET 'e'
 #define OPTION_MAX_LEN 'l'
+#define OPTION_SORTED 's'
+#define OPTION_THREADS 't'
+#define OPTION_TARGETS 'f'
+#define OPTION_FORMAT 4
+#define OPTION_RESUME 5
+#define OPTION_PROGRESS 'p'
 #define OPTION_DECIMAL 1
 #define OPTION_HEXADECIMAL 2
 #define OPTION_HEAP_SIZE 3
+#define OPTION_MASK 'M'
+#define OPTION_CUSTOM_CHARSET1 '1'
+#define OPTION_CUSTOM_CHARSET2 '2'
+#define OPTION_CUSTOM_CHARSET3 '3'
+#define OPTION_CUSTOM_CHARSET4 '4'
+#define OPTION_WORDLIST 'w'
+#define OPTION_RULE 'r'
+#define OPTION_CHAIN_LEN 6
+#define OPTION_CHAINS 7
+#define OPTION_STOP 8
+#define OPTION_SHARD 9
+#define OPTION_MERGE 10
+#define OPTION_EXTEND 11
+#define OPTION_BLOOM 12
+#define OPTION_BLOOM_SIZE 13
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state);
 
@@ -46,8 +74,37 @@ static char const doc[] = "Brute forces a hash by means of a precalculated looku
 \n\
 Examples:\n\
   jhash -h test_str              # Calculate the hash of \"test_str\"\n\
+  jhash -h foo bar baz           # Calculate the hashes of several strings\n\
+  jhash -h -f names.txt          # Calculate the hash of every line of a file\n\
   jhash -g lookup_table          # Generate a lookup table with standard options\n\
+  jhash -g -s lookup_table       # Generate a sorted lookup table for fast cracking\n\
+  jhash -g --format compact tbl  # Generate a sorted table of packed 8 byte records\n\
+  jhash -g --format rainbow -l 8 -t 4 tbl\n\
+                                 # Generate a rainbow table of strings up to length 8\n\
+  jhash -g --shard 0/4 shard0    # Generate the first quarter of a lookup table\n\
+  jhash --merge -s -l 10 tbl shard0 shard1 shard2 shard3\n\
+                                 # Merge the shards into a sorted lookup table\n\
+  jhash -g --extend -l 8 tbl     # Extend an existing lookup table to length 8\n\
   jhash -c lookup_table de3bdc91 # Attempt to crack a hash using a given lookup table\n\
+  jhash -c lookup_table -f -     # Crack every hash listed on stdin in one pass\n\
+  jhash -a -l 6 -f hashes.txt --bloom 0.01 --bloom-size 256\n\
+                                 # Brute force many hashes, turning away misses\n\
+                                 # with a bloom filter of at most 256kB\n\
+  jhash -S /tmp/jhash.sock -t 4 lookup_table\n\
+                                 # Serve lookups from a resident table\n\
+  jhash -Q /tmp/jhash.sock de3bdc91\n\
+                                 # Crack a hash using a running server\n\
+  jhash -m -l 8 de3bdc91         # Find every preimage of a hash up to length 8\n\
+  jhash -a -l 7 -t 8 -p --stop de3bdc91\n\
+                                 # Brute force a hash up to length 7 on 8 threads\n\
+  jhash -a -M '?u?u?u_?d?d' de3bdc91\n\
+                                 # Crack a hash by trying every string of a mask\n\
+  jhash -a -w words.txt -r '?w' -r '?w_?v' -r '?w?d?d' -f hashes.txt\n\
+                                 # Crack hashes with words, pairs of words and\n\
+                                 # words followed by two digits\n\
+  jhash -g -s -M 'title?1?1' -1 '?d.' tbl\n\
+                                 # Generate a sorted lookup table from a mask\n\
+  jhash -b -l 7                  # Benchmark hashing candidates of length 7\n\
 ";
 
 const struct argp_option options[] = {
@@ -55,12 +112,42 @@ const struct argp_option options[] = {
 	{ "hash", OPTION_HASH, 0, 0, "Calculate a hash" },
 	{ "gen-table", OPTION_GEN_TABLE, 0, 0, "Generate a lookup table" },
 	{ "crack", OPTION_CRACK, 0, 0, "Attempt to crack a hash" },
+	{ "mitm", OPTION_MITM, 0, 0, "Attempt to crack a hash without a lookup table" },
+	{ "serve", OPTION_SERVE, "socket", 0, "Keep lookup tables resident and answer lookups on a socket" },
+	{ "query", OPTION_QUERY, "socket", 0, "Attempt to crack a hash using a running server" },
+	{ "merge", OPTION_MERGE, 0, 0, "Combine lookup tables, such as the shards of a table, into one" },
+	{ "attack", OPTION_ATTACK, 0, 0, "Attempt to crack a hash by hashing candidates directly, "
+		"every string up to the maximum length unless given a mask or wordlist" },
+	{ "benchmark", OPTION_BENCHMARK, 0, 0, "Run the hashing micro benchmarks" },
 	{ 0, 0, 0, 0, "Operation modifiers:\n" },
 	{ "decimal", OPTION_DECIMAL, 0, 0, "Treat identifiers as decimal" },
 	{ "hexadecimal", OPTION_HEXADECIMAL, 0, 0, "Treat identifiers as hexadecimal" },
 	{ "extended", OPTION_EXTD_CHARSET, 0, 0, "Use the extended char set to generate a lookup table" },
 	{ "max-length", OPTION_MAX_LEN, "length", 0, "Set the maximum hash string length" },
 	{ "heap-size", OPTION_HEAP_SIZE, "megabytes", 0, "Set the heap size in megabytes" },
+	{ "sorted", OPTION_SORTED, 0, 0, "Generate a sorted, indexed lookup table" },
+	{ "format", OPTION_FORMAT, "format", 0, "Set the lookup table format (legacy, sorted, compact, hashes, rainbow)" },
+	{ "chain-length", OPTION_CHAIN_LEN, "length", 0, "Set the length of rainbow table chains" },
+	{ "chains", OPTION_CHAINS, "count", 0, "Set the number of rainbow table chains" },
+	{ "threads", OPTION_THREADS, "count", 0, "Set the number of worker threads" },
+	{ "shard", OPTION_SHARD, "i/N", 0, "Only generate the i-th of N slices of each length, counting from 0" },
+	{ "resume", OPTION_RESUME, 0, 0, "Resume generating a lookup table from its last checkpoint" },
+	{ "extend", OPTION_EXTEND, 0, 0, "Extend an existing lookup table to the maximum length, "
+		"only generating the lengths it doesn't have" },
+	{ "progress", OPTION_PROGRESS, 0, 0, "Display progress while generating a lookup table" },
+	{ "targets", OPTION_TARGETS, "file", 0, "Read the hashes to crack, or the strings to hash, from a file, or - for stdin" },
+	{ "bloom", OPTION_BLOOM, "rate", 0, "Check a bloom filter of the target hashes first, sized for a false positive rate, eg. 0.01" },
+	{ "bloom-size", OPTION_BLOOM_SIZE, "kilobytes", 0, "Limit the size of the bloom filter of the target hashes" },
+	{ "stop", OPTION_STOP, 0, 0, "Stop attacking once every hash has been cracked once" },
+	{ "mask", OPTION_MASK, "mask", 0, "Only generate or try the strings matching a mask, eg. ?u?u?u_?d?d "
+		"(?u upper, ?l lower, ?d digit, ?s separator, ?a all, ?c charset, ?1-?4 custom, ?? literal ?)" },
+	{ "wordlist", OPTION_WORDLIST, "file", 0, "Try the words of a file, or - for stdin, with --attack" },
+	{ "rule", OPTION_RULE, "rule", 0, "Add a rule building candidates from each word, eg. ?w_?v "
+		"(?w the word, ?v any word of the wordlist, otherwise a mask)" },
+	{ "custom-charset1", OPTION_CUSTOM_CHARSET1, "chars", 0, "Set the custom charset used by ?1 in a mask" },
+	{ "custom-charset2", OPTION_CUSTOM_CHARSET2, "chars", 0, "Set the custom charset used by ?2 in a mask" },
+	{ "custom-charset3", OPTION_CUSTOM_CHARSET3, "chars", 0, "Set the custom charset used by ?3 in a mask" },
+	{ "custom-charset4", OPTION_CUSTOM_CHARSET4, "chars", 0, "Set the custom charset used by ?4 in a mask" },
 	{ 0, 0, 0, 0, "Other options:", GROUP_OTHERS },
 	{ "verbose", OPTION_VERBOSE, 0, 0, "Enable verbose output", GROUP_OTHERS },
 	{ 0 }
@@ -69,7 +156,7 @@ const struct argp_option options[] = {
 const struct argp parser = {
 	.options = options,
 	.parser = parse_opt,
-	.args_doc = "[LOOKUP TABLE] [HASH]",
+	.args_doc = "[LOOKUP TABLE] [HASH]\n[STRING]...\n[HASH]\n[LOOKUP TABLE]...\n[LOOKUP TABLE] [LOOKUP TABLE]...",
 	.doc = doc,
 	.children = NULL,
 	.help_filter = NULL,
@@ -92,15 +179,44 @@ bool parse_args(jhash_args_t* args, int argc, char** argv)
 		print_error("no mode specified", EXIT_FAILURE);
 	}
 
-	if (args->mode != MODE_HASH && strcmp(args->table_path, "") == 0) {
+	if ((args->mode == MODE_GEN_TABLE || args->mode == MODE_CRACK || args->mode == MODE_MERGE) && strcmp(args->table_path, "") == 0) {
 		print_error("no lookup table specified", EXIT_FAILURE);
 	}
 
+	/* with no strings given, every line of the strings file or stdin is hashed */
+	if (args->mode == MODE_HASH && args->num_hash_strings > 0 && strcmp(args->targets_path, "") != 0) {
+		print_error("strings can't be given along with a file of strings", EXIT_FAILURE);
+	}
+
 	if (args->max_len > 16) {
 		print_error("maximum value of max length is 16", EXIT_FAILURE);
 	}
 
-	if (args->mode == MODE_CRACK) {
+	if ((args->mode == MODE_SERVE || args->mode == MODE_MERGE) && args->num_table_paths == 0) {
+		print_error("no lookup table specified", EXIT_FAILURE);
+	}
+
+	if (args->mask_spec != NULL && !mask_parse(&args->mask, args->mask_spec, args->custom_charsets, args->charset)) {
+		print_error("invalid mask specified", EXIT_FAILURE);
+	}
+
+	bool use_wordlist = (strcmp(args->wordlist_path, "") != 0);
+	if (args->mode == MODE_ATTACK && args->mask_spec != NULL && use_wordlist) {
+		print_error("a mask can't be combined with a wordlist, use a rule instead", EXIT_FAILURE);
+	}
+
+	if (use_wordlist && strcmp(args->wordlist_path, args->targets_path) == 0 && strcmp(args->targets_path, "-") == 0) {
+		print_error("the wordlist and target hashes can't both be read from stdin", EXIT_FAILURE);
+	}
+
+	/* compact, hash only and rainbow tables rebuild strings from the charset */
+	if (args->mode == MODE_GEN_TABLE && args->mask_spec != NULL && (args->table_format == TABLE_FORMAT_COMPACT ||
+			args->table_format == TABLE_FORMAT_HASHES || args->table_format == TABLE_FORMAT_RAINBOW)) {
+		print_error("mask tables must be legacy or sorted", EXIT_FAILURE);
+	}
+
+	if (args->mode == MODE_MITM ||
+			((args->mode == MODE_CRACK || args->mode == MODE_QUERY || args->mode == MODE_ATTACK) && strcmp(args->targets_path, "") == 0)) {
 		switch (args->ident_mode) {
 		case HASH_DECIMAL:
 			args->target_hash = strtol(args->target_string, NULL, 10);
@@ -118,7 +234,30 @@ bool parse_args(jhash_args_t* args, int argc, char** argv)
 		print_error("invalid heap size specified", EXIT_FAILURE);
 	}
 
-	if (args->mode == MODE_GEN_TABLE && args->max_len == 0) {
+	if (args->num_shards < 1 || args->shard < 0 || args->shard >= args->num_shards) {
+		print_error("invalid shard specified", EXIT_FAILURE);
+	}
+
+	/* only tables of strings can be sharded and merged, the others are indexed by rank */
+	if (((args->mode == MODE_GEN_TABLE && args->num_shards > 1) || args->mode == MODE_MERGE) &&
+			args->table_format != TABLE_FORMAT_LEGACY && args->table_format != TABLE_FORMAT_SORTED) {
+		print_error("sharded and merged tables must be legacy or sorted", EXIT_FAILURE);
+	}
+
+	/* an extended table takes its charset and format from the table itself */
+	if (args->extend && (args->resume || args->mask_spec != NULL || args->num_shards > 1)) {
+		print_error("a table can't be extended with a mask, shard or resume", EXIT_FAILURE);
+	}
+
+	if (args->chain_len == 0 || args->chain_len > UINT32_MAX || args->num_chains == 0) {
+		print_error("invalid rainbow table size specified", EXIT_FAILURE);
+	}
+
+	if (args->threads < 1 || args->threads > GEN_MAX_THREADS) {
+		print_error("invalid thread count specified", EXIT_FAILURE);
+	}
+
+	if ((args->mode == MODE_GEN_TABLE || args->mode == MODE_BENCHMARK || args->mode == MODE_MITM || args->mode == MODE_ATTACK) && args->max_len == 0) {
 		print_error("invalid max length specified", EXIT_FAILURE);
 	}
 
@@ -168,6 +307,26 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 	case OPTION_CRACK:
 		new_mode = MODE_CRACK;
 		break;
+	case OPTION_BENCHMARK:
+		new_mode = MODE_BENCHMARK;
+		break;
+	case OPTION_MITM:
+		new_mode = MODE_MITM;
+		break;
+	case OPTION_SERVE:
+		new_mode = MODE_SERVE;
+		snprintf(jhash_args->socket_path, sizeof(jhash_args->socket_path), "%s", arg);
+		break;
+	case OPTION_QUERY:
+		new_mode = MODE_QUERY;
+		snprintf(jhash_args->socket_path, sizeof(jhash_args->socket_path), "%s", arg);
+		break;
+	case OPTION_ATTACK:
+		new_mode = MODE_ATTACK;
+		break;
+	case OPTION_MERGE:
+		new_mode = MODE_MERGE;
+		break;
 	case OPTION_DECIMAL:
 		jhash_args->ident_mode = HASH_DECIMAL;
 		break;
@@ -182,13 +341,103 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 		break;
 	case OPTION_MAX_LEN:
 		jhash_args->max_len = strtol(arg, NULL, 10);
+		jhash_args->max_len_given = true;
 		break;
 	case OPTION_HEAP_SIZE:
 		jhash_args->heap_mb = strtol(arg, NULL, 10);
 		break;
+	case OPTION_SORTED:
+		jhash_args->table_format = TABLE_FORMAT_SORTED;
+		break;
+	case OPTION_FORMAT:
+		if (strcmp(arg, "legacy") == 0) {
+			jhash_args->table_format = TABLE_FORMAT_LEGACY;
+		} else if (strcmp(arg, "sorted") == 0) {
+			jhash_args->table_format = TABLE_FORMAT_SORTED;
+		} else if (strcmp(arg, "compact") == 0) {
+			jhash_args->table_format = TABLE_FORMAT_COMPACT;
+		} else if (strcmp(arg, "hashes") == 0) {
+			jhash_args->table_format = TABLE_FORMAT_HASHES;
+		} else if (strcmp(arg, "rainbow") == 0) {
+			jhash_args->table_format = TABLE_FORMAT_RAINBOW;
+		} else {
+			print_error("unknown table format", EXIT_FAILURE);
+		}
+		break;
+	case OPTION_CHAIN_LEN:
+		jhash_args->chain_len = strtoull(arg, NULL, 10);
+		break;
+	case OPTION_CHAINS:
+		jhash_args->num_chains = strtoull(arg, NULL, 10);
+		break;
+	case OPTION_THREADS:
+		jhash_args->threads = strtol(arg, NULL, 10);
+		break;
+	case OPTION_SHARD:
+		if (sscanf(arg, "%d/%d", &jhash_args->shard, &jhash_args->num_shards) != 2) {
+			print_error("invalid shard specified", EXIT_FAILURE);
+		}
+		break;
+	case OPTION_RESUME:
+		jhash_args->resume = true;
+		break;
+	case OPTION_BLOOM:
+		jhash_args->bloom_fp = strtod(arg, NULL);
+		if (jhash_args->bloom_fp <= 0 || jhash_args->bloom_fp >= 1) {
+			print_error("invalid bloom filter false positive rate specified", EXIT_FAILURE);
+		}
+		break;
+	case OPTION_BLOOM_SIZE:
+		jhash_args->bloom_kb = strtoul(arg, NULL, 10);
+		if (jhash_args->bloom_kb == 0) {
+			print_error("invalid bloom filter size specified", EXIT_FAILURE);
+		}
+		break;
+	case OPTION_EXTEND:
+		jhash_args->extend = true;
+		break;
+	case OPTION_PROGRESS:
+		jhash_args->progress = true;
+		break;
+	case OPTION_STOP:
+		jhash_args->stop_on_found = true;
+		break;
+	case OPTION_TARGETS:
+		strncpy(jhash_args->targets_path, arg, sizeof(jhash_args->targets_path)-1);
+		break;
+	case OPTION_MASK:
+		jhash_args->mask_spec = arg;
+		break;
+	case OPTION_CUSTOM_CHARSET1:
+	case OPTION_CUSTOM_CHARSET2:
+	case OPTION_CUSTOM_CHARSET3:
+	case OPTION_CUSTOM_CHARSET4:
+		jhash_args->custom_charsets[key - OPTION_CUSTOM_CHARSET1] = arg;
+		break;
+	case OPTION_WORDLIST:
+		strncpy(jhash_args->wordlist_path, arg, sizeof(jhash_args->wordlist_path)-1);
+		break;
+	case OPTION_RULE: {
+		int count = jhash_args->num_rules++;
+		jhash_args->rules = (char**)realloc(jhash_args->rules, (count+1)*sizeof(char*));
+		jhash_args->rules[count] = arg;
+		break;
+	}
 	case ARGP_KEY_ARG:
-		if (jhash_args->mode == MODE_HASH) {
-			if (state->arg_num == 0) { /* first arg = string to hash */
+		if (jhash_args->mode == MODE_HASH) { /* all args = strings to hash */
+			int count = jhash_args->num_hash_strings++;
+			jhash_args->hash_strings = (char**)realloc(jhash_args->hash_strings, (count+1)*sizeof(char*));
+			jhash_args->hash_strings[count] = arg;
+		} else if (jhash_args->mode == MODE_SERVE) { /* all args = lookup tables */
+			int count = jhash_args->num_table_paths++;
+			jhash_args->table_paths = (char**)realloc(jhash_args->table_paths, (count+1)*sizeof(char*));
+			jhash_args->table_paths[count] = arg;
+		} else if (jhash_args->mode == MODE_MERGE && state->arg_num > 0) { /* lookup tables after the first = inputs */
+			int count = jhash_args->num_table_paths++;
+			jhash_args->table_paths = (char**)realloc(jhash_args->table_paths, (count+1)*sizeof(char*));
+			jhash_args->table_paths[count] = arg;
+		} else if (jhash_args->mode == MODE_MITM || jhash_args->mode == MODE_QUERY || jhash_args->mode == MODE_ATTACK) {
+			if (state->arg_num == 0) { /* first arg = hash to crack */
 				strcpy(jhash_args->target_string, arg);
 			} else {
 				return ARGP_ERR_UNKNOWN;
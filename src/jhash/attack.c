@@ -0,0 +1,317 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/attack.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <jhash/jhash.h>
+#include <jhash/mask.h>
+#include <jhash/crack.h>
+#include <jhash/targets.h>
+
+/**
+ * Hashes every candidate of a mask, or of every length up to max_len over
+ * the charset, directly against the target set, without a table. The masks
+ * are laid end to end as one range of ranks, which is split evenly between
+ * the workers. A worker hashes its range a slice at a time, and once it runs
+ * out steals the back half of the largest range left, so a slow thread
+ * never holds up the others.
+ */
+
+typedef struct attack_range attack_range_t;
+typedef struct attack_state attack_state_t;
+typedef struct attack_worker attack_worker_t;
+
+struct attack_range {
+	pthread_mutex_t lock;
+	uint64_t next;
+	uint64_t end;
+};
+
+struct attack_state {
+	mask_t* masks;
+	int num_masks;
+	uint64_t offsets[KEYSPACE_MAX_LENGTH+1]; /* the first rank of each mask */
+	uint64_t total;
+	attack_range_t* ranges; /* one per worker */
+	int num_threads;
+	target_set_t* targets;
+	size_t remaining; /* targets not yet found */
+	bool stop_on_found;
+	bool stopped;
+	uint64_t searched;
+	int finished; /* workers which have run out of work */
+	pthread_mutex_t lock;
+};
+
+struct attack_worker {
+	pthread_t thread;
+	attack_state_t* state;
+	int index;
+};
+
+/**
+ * Seconds since some arbitrary point, for timing
+ */
+static double attack_now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec/1e9;
+}
+
+/**
+ * Outputs a match for a target, marking it found and stopping the search
+ * once every target has been, if asked to
+ */
+static void attack_report(attack_state_t* state, jhash_t hash, const char* string)
+{
+	pthread_mutex_lock(&state->lock);
+	bool* found = &state->targets->found[target_set_find(state->targets, hash)];
+	if (!*found) {
+		*found = true;
+		state->remaining--;
+		if (state->remaining == 0 && state->stop_on_found) {
+			__atomic_store_n(&state->stopped, true, __ATOMIC_RELAXED);
+		}
+	}
+	char hash_str[32];
+	format_hash(hash, hash_str);
+	printf("%s\t%s\n", hash_str, string);
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Takes the next slice of a worker's range, stealing half of the largest
+ * other range when its own is empty. Returns false once there's no work left.
+ */
+static bool attack_take(attack_state_t* state, int worker, uint64_t* start, uint64_t* end)
+{
+	attack_range_t* own = &state->ranges[worker];
+	while (!__atomic_load_n(&state->stopped, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&own->lock);
+		if (own->next < own->end) {
+			*start = own->next;
+			*end = (own->end - own->next > ATTACK_SLICE_SIZE) ? own->next + ATTACK_SLICE_SIZE : own->end;
+			own->next = *end;
+			pthread_mutex_unlock(&own->lock);
+			return true;
+		}
+		pthread_mutex_unlock(&own->lock);
+
+		/* pick the victim with the most left, without locking, then recheck */
+		int victim = -1;
+		uint64_t most = 0;
+		for (int i = 0; i < state->num_threads; i++) {
+			uint64_t next = __atomic_load_n(&state->ranges[i].next, __ATOMIC_RELAXED);
+			uint64_t end = __atomic_load_n(&state->ranges[i].end, __ATOMIC_RELAXED);
+			if (i != worker && end > next && end - next > most) {
+				victim = i;
+				most = end - next;
+			}
+		}
+		if (victim < 0) {
+			return false;
+		}
+
+		attack_range_t* range = &state->ranges[victim];
+		pthread_mutex_lock(&range->lock);
+		uint64_t stolen_start = range->next;
+		uint64_t stolen_end = range->end;
+		if (stolen_end - stolen_start > ATTACK_SLICE_SIZE) {
+			stolen_start += (stolen_end - stolen_start)/2;
+		}
+		range->end = stolen_start;
+		pthread_mutex_unlock(&range->lock);
+
+		pthread_mutex_lock(&own->lock);
+		own->next = stolen_start;
+		own->end = stolen_end;
+		pthread_mutex_unlock(&own->lock);
+	}
+	return false;
+}
+
+/**
+ * Hashes the candidates of [start, end) within one mask. A single target is
+ * compared directly rather than looked up in the set.
+ */
+static void attack_search_mask(attack_state_t* state, const mask_t* mask, uint64_t start, uint64_t end)
+{
+	target_set_t* targets = state->targets;
+	keyspace_iter_t iter;
+	mask_iter_init(&iter, mask, start);
+	if (targets->count == 1) {
+		jhash_t target = targets->targets[0];
+		for (uint64_t rank = start; rank < end; rank++) {
+			if (keyspace_iter_hash(&iter) == target) {
+				attack_report(state, target, iter.string);
+			}
+			keyspace_iter_next(&iter);
+		}
+		return;
+	}
+
+	for (uint64_t rank = start; rank < end; rank++) {
+		jhash_t hash = keyspace_iter_hash(&iter);
+		if (target_set_contains(targets, hash)) {
+			attack_report(state, hash, iter.string);
+		}
+		keyspace_iter_next(&iter);
+	}
+}
+
+/**
+ * Hashes the candidates of [start, end), which may span several masks
+ */
+static void attack_search(attack_state_t* state, uint64_t start, uint64_t end)
+{
+	int i = 0;
+	while (start < end) {
+		while (start >= state->offsets[i+1]) {
+			i++;
+		}
+		uint64_t mask_end = (end < state->offsets[i+1]) ? end : state->offsets[i+1];
+		attack_search_mask(state, &state->masks[i], start - state->offsets[i], mask_end - state->offsets[i]);
+		start = mask_end;
+	}
+}
+
+/**
+ * Worker thread entry point, hashes slices until there's no work left
+ */
+static void* attack_worker_run(void* data)
+{
+	attack_worker_t* worker = (attack_worker_t*)data;
+	attack_state_t* state = worker->state;
+	uint64_t start, end;
+	while (attack_take(state, worker->index, &start, &end)) {
+		attack_search(state, start, end);
+		__atomic_fetch_add(&state->searched, end - start, __ATOMIC_RELAXED);
+	}
+	__atomic_fetch_add(&state->finished, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/**
+ * Prints the search rate, and how far through it is unless final
+ */
+static void attack_progress_report(attack_state_t* state, double start_time, bool final)
+{
+	uint64_t searched = __atomic_load_n(&state->searched, __ATOMIC_RELAXED);
+	double elapsed = attack_now() - start_time;
+	double rate = elapsed > 0 ? searched/elapsed : 0;
+	if (final) {
+		fprintf(stderr, "searched %lu candidates in %.2fs (%.2f MH/s)\n", (unsigned long)searched, elapsed, rate/1e6);
+	} else {
+		fprintf(stderr, "\r%5.1f%%, %.2f MH/s", 100.0*searched/state->total, rate/1e6);
+	}
+}
+
+/**
+ * Attempt to crack the target hashes by hashing every candidate of a mask,
+ * or every string up to max_len
+ */
+void crack_attack(jhash_args_t* args)
+{
+	target_set_t targets;
+	crack_load_targets(args, &targets);
+
+	attack_state_t state;
+	memset(&state, 0, sizeof(attack_state_t));
+	state.targets = &targets;
+	state.remaining = targets.count;
+	state.stop_on_found = args->stop_on_found;
+	pthread_mutex_init(&state.lock, NULL);
+
+	/* lay the masks end to end */
+	if (args->mask_spec != NULL) {
+		state.masks = &args->mask;
+		state.num_masks = 1;
+	} else {
+		state.num_masks = args->max_len;
+		state.masks = (mask_t*)malloc(state.num_masks*sizeof(mask_t));
+		for (int i = 0; i < state.num_masks; i++) {
+			mask_from_charset(&state.masks[i], args->charset, i+1);
+		}
+	}
+	for (int i = 0; i < state.num_masks; i++) {
+		uint64_t size = mask_size(&state.masks[i]);
+		if (size == KEYSPACE_OVERFLOW || state.offsets[i] > KEYSPACE_OVERFLOW - size) {
+			print_error("keyspace too large", EXIT_FAILURE);
+		}
+		state.offsets[i+1] = state.offsets[i] + size;
+	}
+	state.total = state.offsets[state.num_masks];
+
+	/* split the range evenly to begin with, work stealing balances it from there */
+	int num_threads = args->threads;
+	attack_range_t ranges[num_threads];
+	attack_worker_t workers[num_threads];
+	state.ranges = ranges;
+	state.num_threads = num_threads;
+	for (int i = 0; i < num_threads; i++) {
+		pthread_mutex_init(&ranges[i].lock, NULL);
+		ranges[i].next = state.total/num_threads*i;
+		ranges[i].end = (i == num_threads-1) ? state.total : state.total/num_threads*(i+1);
+	}
+
+	double start_time = attack_now();
+	for (int i = 0; i < num_threads; i++) {
+		workers[i].state = &state;
+		workers[i].index = i;
+		if (pthread_create(&workers[i].thread, NULL, attack_worker_run, &workers[i]) != 0) {
+			print_error("unable to start worker thread", EXIT_FAILURE);
+		}
+	}
+	double last_report = start_time;
+	while (args->progress && __atomic_load_n(&state.finished, __ATOMIC_ACQUIRE) < num_threads) {
+		struct timespec interval = { 0, 100*1000*1000 };
+		nanosleep(&interval, NULL);
+		if (attack_now() - last_report >= ATTACK_PROGRESS_INTERVAL) {
+			last_report = attack_now();
+			attack_progress_report(&state, start_time, false);
+		}
+	}
+	for (int i = 0; i < num_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		pthread_mutex_destroy(&ranges[i].lock);
+	}
+	if (args->progress) {
+		fprintf(stderr, "\n");
+	}
+	if (args->progress || args->verbose) {
+		attack_progress_report(&state, start_time, true);
+	}
+
+	for (size_t i = 0; i < targets.count; i++) {
+		jhash_t hash = targets.targets[i];
+		if (!targets.found[target_set_find(&targets, hash)]) {
+			fprintf(stderr, "unable to find result for %x (searched %lu)\n", hash, (unsigned long)state.searched);
+		}
+	}
+
+	if (state.masks != &args->mask) {
+		free(state.masks);
+	}
+	pthread_mutex_destroy(&state.lock);
+	target_set_free(&targets);
+}
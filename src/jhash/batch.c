@@ -0,0 +1,302 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/batch.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_X86
+#endif
+
+/**
+ * The vector kernels compute a character's value as c - 32, optionally
+ * folding lower case to upper case and/or treating bytes over 127 as
+ * negative. batch_init works out which of these matches jagex_hash for every
+ * byte value, and leaves the scalar kernel selected if none do.
+ */
+static bool fold_case = false;
+static bool signed_chars = false;
+
+typedef void (*batch_kernel_t)(const batch_string_t* strings, size_t count, jhash_t* out);
+
+static batch_kernel_t batch_kernel = jagex_hash_batch_scalar;
+static const char* batch_kernel_desc = "scalar";
+static bool batch_vectors_match = false; /* whether any settings matched, so the vector kernels can be used */
+
+/**
+ * Hashes a batch of strings one at a time with jagex_hash
+ */
+void jagex_hash_batch_scalar(const batch_string_t* strings, size_t count, jhash_t* out)
+{
+	char string[BATCH_STRING_LEN+1];
+	string[BATCH_STRING_LEN] = '\0';
+	for (size_t i = 0; i < count; i++) {
+		memcpy(string, strings[i], BATCH_STRING_LEN);
+		out[i] = jagex_hash(string);
+	}
+}
+
+#ifdef BATCH_X86
+
+/**
+ * Transposes four rows of four dwords, so that row i then holds dword i of
+ * each original row. The V_* names are bound to one instruction set below.
+ */
+#define BATCH_TRANSPOSE4(r0, r1, r2, r3) do { \
+	t0 = V_UNPACKLO32(r0, r1); \
+	t1 = V_UNPACKLO32(r2, r3); \
+	t2 = V_UNPACKHI32(r0, r1); \
+	t3 = V_UNPACKHI32(r2, r3); \
+	r0 = V_UNPACKLO64(t0, t1); \
+	r1 = V_UNPACKHI64(t0, t1); \
+	r2 = V_UNPACKLO64(t2, t3); \
+	r3 = V_UNPACKHI64(t2, t3); \
+} while (0)
+
+/**
+ * Folds the next character of each lane into the lane's hash. Lanes which
+ * have hit their null padding are left alone.
+ */
+#define BATCH_STEP(hash, column, shift) do { \
+	c = V_AND(V_SRLI32(column, shift), byte_mask); \
+	v = V_SUB32(c, space); \
+	if (fold_case) { \
+		v = V_SUB32(v, V_AND(space, V_AND(V_CMPGT32(c, lower_a), V_CMPGT32(lower_z, c)))); \
+	} \
+	if (signed_chars) { \
+		v = V_SUB32(v, V_AND(V_CMPGT32(c, high_bit), sign_adjust)); \
+	} \
+	v = V_ADD32(V_MULLO32(hash, sixty), v); \
+	hash = V_ADD32(hash, V_ANDNOT(V_CMPEQ32(c, zero), v)); \
+} while (0)
+
+#define V_UNPACKLO32 _mm_unpacklo_epi32
+#define V_UNPACKHI32 _mm_unpackhi_epi32
+#define V_UNPACKLO64 _mm_unpacklo_epi64
+#define V_UNPACKHI64 _mm_unpackhi_epi64
+#define V_AND _mm_and_si128
+#define V_ANDNOT _mm_andnot_si128
+#define V_SRLI32 _mm_srli_epi32
+#define V_ADD32 _mm_add_epi32
+#define V_SUB32 _mm_sub_epi32
+#define V_MULLO32 _mm_mullo_epi32
+#define V_CMPGT32 _mm_cmpgt_epi32
+#define V_CMPEQ32 _mm_cmpeq_epi32
+
+/**
+ * SSE4.1 kernel, 2 x 4 lanes
+ */
+__attribute__((target("sse4.1")))
+static void jagex_hash_batch_sse41(const batch_string_t* strings, size_t count, jhash_t* out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i byte_mask = _mm_set1_epi32(0xff);
+	const __m128i space = _mm_set1_epi32(32);
+	const __m128i sixty = _mm_set1_epi32(60);
+	const __m128i lower_a = _mm_set1_epi32('a'-1);
+	const __m128i lower_z = _mm_set1_epi32('z'+1);
+	const __m128i high_bit = _mm_set1_epi32(127);
+	const __m128i sign_adjust = _mm_set1_epi32(256);
+	__m128i t0, t1, t2, t3, c, v;
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i a[4], b[4];
+		for (int j = 0; j < 4; j++) {
+			a[j] = _mm_loadu_si128((const __m128i*)strings[i+j]);
+			b[j] = _mm_loadu_si128((const __m128i*)strings[i+j+4]);
+		}
+		BATCH_TRANSPOSE4(a[0], a[1], a[2], a[3]);
+		BATCH_TRANSPOSE4(b[0], b[1], b[2], b[3]);
+
+		__m128i hash_a = zero;
+		__m128i hash_b = zero;
+		for (int j = 0; j < 4; j++) {
+			for (int shift = 0; shift < 32; shift += 8) {
+				BATCH_STEP(hash_a, a[j], shift);
+				BATCH_STEP(hash_b, b[j], shift);
+			}
+		}
+		_mm_storeu_si128((__m128i*)&out[i], hash_a);
+		_mm_storeu_si128((__m128i*)&out[i+4], hash_b);
+	}
+	jagex_hash_batch_scalar(&strings[i], count - i, &out[i]);
+}
+
+#undef V_UNPACKLO32
+#undef V_UNPACKHI32
+#undef V_UNPACKLO64
+#undef V_UNPACKHI64
+#undef V_AND
+#undef V_ANDNOT
+#undef V_SRLI32
+#undef V_ADD32
+#undef V_SUB32
+#undef V_MULLO32
+#undef V_CMPGT32
+#undef V_CMPEQ32
+
+#define V_UNPACKLO32 _mm256_unpacklo_epi32
+#define V_UNPACKHI32 _mm256_unpackhi_epi32
+#define V_UNPACKLO64 _mm256_unpacklo_epi64
+#define V_UNPACKHI64 _mm256_unpackhi_epi64
+#define V_AND _mm256_and_si256
+#define V_ANDNOT _mm256_andnot_si256
+#define V_SRLI32 _mm256_srli_epi32
+#define V_ADD32 _mm256_add_epi32
+#define V_SUB32 _mm256_sub_epi32
+#define V_MULLO32 _mm256_mullo_epi32
+#define V_CMPGT32 _mm256_cmpgt_epi32
+#define V_CMPEQ32 _mm256_cmpeq_epi32
+
+/**
+ * AVX2 kernel, 2 x 8 lanes
+ */
+__attribute__((target("avx2")))
+static void jagex_hash_batch_avx2(const batch_string_t* strings, size_t count, jhash_t* out)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i byte_mask = _mm256_set1_epi32(0xff);
+	const __m256i space = _mm256_set1_epi32(32);
+	const __m256i sixty = _mm256_set1_epi32(60);
+	const __m256i lower_a = _mm256_set1_epi32('a'-1);
+	const __m256i lower_z = _mm256_set1_epi32('z'+1);
+	const __m256i high_bit = _mm256_set1_epi32(127);
+	const __m256i sign_adjust = _mm256_set1_epi32(256);
+	__m256i t0, t1, t2, t3, c, v;
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		/* row j holds string j in its low half and string j+4 in its high half */
+		__m256i a[4], b[4];
+		for (int j = 0; j < 4; j++) {
+			a[j] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)strings[i+j])),
+				_mm_loadu_si128((const __m128i*)strings[i+j+4]), 1);
+			b[j] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)strings[i+j+8])),
+				_mm_loadu_si128((const __m128i*)strings[i+j+12]), 1);
+		}
+		BATCH_TRANSPOSE4(a[0], a[1], a[2], a[3]);
+		BATCH_TRANSPOSE4(b[0], b[1], b[2], b[3]);
+
+		__m256i hash_a = zero;
+		__m256i hash_b = zero;
+		for (int j = 0; j < 4; j++) {
+			for (int shift = 0; shift < 32; shift += 8) {
+				BATCH_STEP(hash_a, a[j], shift);
+				BATCH_STEP(hash_b, b[j], shift);
+			}
+		}
+		_mm256_storeu_si256((__m256i*)&out[i], hash_a);
+		_mm256_storeu_si256((__m256i*)&out[i+8], hash_b);
+	}
+	jagex_hash_batch_sse41(&strings[i], count - i, &out[i]);
+}
+
+#endif /* BATCH_X86 */
+
+/**
+ * The value the vector kernels give a character under the current settings
+ */
+static uint32_t batch_char_value(unsigned char c)
+{
+	uint32_t value = (uint32_t)c - 32;
+	if (fold_case && c >= 'a' && c <= 'z') {
+		value -= 32;
+	}
+	if (signed_chars && c > 127) {
+		value -= 256;
+	}
+	return value;
+}
+
+/**
+ * Checks the current settings against jagex_hash for every byte value
+ */
+static bool batch_settings_match()
+{
+	for (int c = 1; c < 256; c++) {
+		char string[2] = { (char)c, '\0' };
+		if ((uint32_t)jagex_hash(string) != batch_char_value(c)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Selects the fastest kernel this cpu supports which agrees with jagex_hash
+ */
+void batch_init()
+{
+	batch_vectors_match = false;
+	for (int settings = 0; settings < 4 && !batch_vectors_match; settings++) {
+		fold_case = (settings & 1);
+		signed_chars = (settings & 2);
+		batch_vectors_match = batch_settings_match();
+	}
+	if (!batch_select("avx2") && !batch_select("sse4.1")) {
+		batch_select("scalar");
+	}
+}
+
+/**
+ * Selects a kernel by name ("scalar", "sse4.1" or "avx2"), returning false
+ * if this cpu doesn't support it or it wouldn't agree with jagex_hash
+ */
+bool batch_select(const char* name)
+{
+	if (strcmp(name, "scalar") == 0) {
+		batch_kernel = jagex_hash_batch_scalar;
+		batch_kernel_desc = "scalar";
+		return true;
+	}
+#ifdef BATCH_X86
+	__builtin_cpu_init();
+	if (batch_vectors_match && strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+		batch_kernel = jagex_hash_batch_avx2;
+		batch_kernel_desc = "avx2";
+		return true;
+	}
+	if (batch_vectors_match && strcmp(name, "sse4.1") == 0 && __builtin_cpu_supports("sse4.1")) {
+		batch_kernel = jagex_hash_batch_sse41;
+		batch_kernel_desc = "sse4.1";
+		return true;
+	}
+#endif
+	return false;
+}
+
+/**
+ * The name of the selected kernel
+ */
+const char* batch_kernel_name()
+{
+	return batch_kernel_desc;
+}
+
+/**
+ * Hashes a batch of null padded strings with the selected kernel
+ */
+void jagex_hash_batch(const batch_string_t* strings, size_t count, jhash_t* out)
+{
+	batch_kernel(strings, count, out);
+}
@@ -0,0 +1,279 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/benchmark.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <jhash/keyspace.h>
+#include <jhash/batch.h>
+#include <jhash/bulk.h>
+#include <jhash/jhash.h>
+
+/**
+ * Seconds since some arbitrary point, for timing
+ */
+static double bench_now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec/1e9;
+}
+
+/**
+ * Prints a benchmark result
+ */
+static void bench_report(const char* name, uint64_t count, double seconds, const char* unit)
+{
+	printf("%-24s %12.0f %s/sec (%.3fs)\n", name, count/seconds, unit, seconds);
+}
+
+/**
+ * The generator's original loop, rebuilding and rehashing the whole string per candidate
+ */
+static uint32_t bench_naive(const char* charset, int length, uint64_t count)
+{
+	/* Adapted from 'Jerome' @ stackoverflow (http://goo.gl/dvVArI) */
+	const char* buffer[length];
+	char string[KEYSPACE_MAX_LENGTH+1];
+	memset(string, 0, sizeof(string));
+	keyspace_unrank(charset, length, 0, buffer);
+	uint32_t checksum = 0;
+	for (uint64_t n = 0; n < count; n++) {
+		int i;
+		for (i = 0; i < length; i++) {
+			string[i] = *buffer[i];
+		}
+		checksum ^= (uint32_t)jagex_hash(string);
+		for (i = 0; i < length && *(++buffer[i]) == '\0'; i++) {
+			buffer[i] = &charset[0];
+		}
+	}
+	return checksum;
+}
+
+/**
+ * The incremental prefix hashing engine
+ */
+static uint32_t bench_incremental(const char* charset, int length, uint64_t count)
+{
+	keyspace_iter_t iter;
+	keyspace_iter_init(&iter, charset, length, 0);
+	uint32_t checksum = 0;
+	for (uint64_t n = 0; n < count; n++) {
+		checksum ^= (uint32_t)keyspace_iter_hash(&iter);
+		keyspace_iter_next(&iter);
+	}
+	return checksum;
+}
+
+/**
+ * Benchmarks the candidate generation engines against each other
+ */
+static void bench_generation(const char* charset, int length)
+{
+	uint64_t count = BENCH_CANDIDATES;
+	printf("candidate generation, length %d:\n", length);
+
+	double start = bench_now();
+	uint32_t naive = bench_naive(charset, length, count);
+	bench_report("naive", count, bench_now() - start, "candidates");
+
+	start = bench_now();
+	uint32_t incremental = bench_incremental(charset, length, count);
+	bench_report("incremental", count, bench_now() - start, "candidates");
+
+	if (naive != incremental) {
+		print_error("incremental hashing disagrees with jagex_hash", EXIT_FAILURE);
+	}
+}
+
+/**
+ * Fills a batch with edge cases followed by random strings of random lengths
+ */
+static void bench_fill_strings(batch_string_t* strings, size_t count)
+{
+	memset(strings, 0, count*sizeof(batch_string_t));
+	size_t n = 0;
+
+	/* every byte value in every position, then full width strings */
+	for (int c = 1; c < 256 && n < count; c++) {
+		for (int pos = 0; pos < BATCH_STRING_LEN && n < count; pos++, n++) {
+			memset(strings[n], 'A', pos);
+			strings[n][pos] = (char)c;
+		}
+	}
+	for (int c = 1; c < 256 && n < count; c++, n++) {
+		memset(strings[n], c, BATCH_STRING_LEN);
+	}
+
+	srand(0x6a686173);
+	for (; n < count; n++) {
+		int length = rand() % (BATCH_STRING_LEN+1);
+		for (int i = 0; i < length; i++) {
+			strings[n][i] = (char)(1 + rand() % 255);
+		}
+	}
+}
+
+/**
+ * Checks the selected batch kernel against jagex_hash, over the whole batch
+ * and then over every tail length short of two of the widest kernel's
+ * iterations, both aligned and not
+ */
+static bool bench_batch_agrees(const batch_string_t* strings, const jhash_t* expected, size_t count, jhash_t* out)
+{
+	jagex_hash_batch(strings, count, out);
+	if (memcmp(out, expected, count*sizeof(jhash_t)) != 0) {
+		return false;
+	}
+	for (size_t offset = 0; offset < 2; offset++) {
+		for (size_t length = 0; length < BENCH_BATCH_TAILS && offset + length <= count; length++) {
+			jagex_hash_batch(&strings[offset], length, out);
+			if (memcmp(out, &expected[offset], length*sizeof(jhash_t)) != 0) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Benchmarks the batch hashing kernel against scalar jagex_hash, then checks
+ * every kernel this cpu supports agrees with it exactly
+ */
+static void bench_batch()
+{
+	size_t count = BENCH_CANDIDATES/4;
+	batch_string_t* strings = (batch_string_t*)malloc(count*sizeof(batch_string_t));
+	jhash_t* scalar = (jhash_t*)malloc(count*sizeof(jhash_t));
+	jhash_t* batch = (jhash_t*)malloc(count*sizeof(jhash_t));
+	bench_fill_strings(strings, count);
+	printf("batch hashing, %s kernel:\n", batch_kernel_name());
+
+	double start = bench_now();
+	jagex_hash_batch_scalar(strings, count, scalar);
+	bench_report("jagex_hash", count, bench_now() - start, "strings");
+
+	start = bench_now();
+	jagex_hash_batch(strings, count, batch);
+	bench_report("jagex_hash_batch", count, bench_now() - start, "strings");
+
+	/* not just the selected kernel, as the faster ones hand their tails to the slower */
+	const char* kernels[] = { "scalar", "sse4.1", "avx2" };
+	for (size_t k = 0; k < sizeof(kernels)/sizeof(kernels[0]); k++) {
+		if (!batch_select(kernels[k])) {
+			printf("%-24s unsupported\n", kernels[k]);
+			continue;
+		}
+		if (!bench_batch_agrees(strings, scalar, count, batch)) {
+			char message[64];
+			snprintf(message, sizeof(message), "%s batch kernel disagrees with jagex_hash", kernels[k]);
+			print_error(message, EXIT_FAILURE);
+		}
+		printf("%-24s agrees with jagex_hash\n", kernels[k]);
+	}
+	batch_init();
+
+	free(batch);
+	free(scalar);
+	free(strings);
+}
+
+/**
+ * Hashes lines the way a pipeline would without bulk hashing, one
+ * jagex_hash and printf per line
+ */
+static void bench_lines_naive(FILE* in, FILE* out)
+{
+	char line[BULK_BUFFER_SIZE];
+	while (fgets(line, sizeof(line), in) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+		char hash_str[32];
+		format_hash(jagex_hash(line), hash_str);
+		fprintf(out, "%s\t%s\n", hash_str, line);
+	}
+	fflush(out);
+}
+
+/**
+ * Benchmarks bulk hashing of newline delimited strings against hashing
+ * them a line at a time, checking they output the same
+ */
+static void bench_bulk(const char* charset, int ident_mode)
+{
+	size_t num_lines = BENCH_CANDIDATES/8;
+	size_t input_size = num_lines*(BATCH_STRING_LEN+5);
+	size_t output_size = input_size + num_lines*12;
+	char* input = (char*)malloc(input_size);
+	char* naive = (char*)malloc(output_size);
+	char* bulk = (char*)malloc(output_size);
+	if (!input || !naive || !bulk) {
+		print_error("unable to allocate benchmark buffers", EXIT_FAILURE);
+	}
+
+	/* identifier-like names, a few too long for the batch kernel */
+	srand(0x62756c6b);
+	size_t charset_len = strlen(charset);
+	size_t length = 0;
+	for (size_t n = 0; n < num_lines; n++) {
+		int name_len = 1 + rand() % (BATCH_STRING_LEN+4);
+		for (int i = 0; i < name_len; i++) {
+			input[length++] = charset[rand() % charset_len];
+		}
+		input[length++] = '\n';
+	}
+	printf("bulk hashing, %zu lines:\n", num_lines);
+
+	FILE* in = fmemopen(input, length, "r");
+	FILE* out = fmemopen(naive, output_size, "w");
+	double start = bench_now();
+	bench_lines_naive(in, out);
+	bench_report("fgets/printf", num_lines, bench_now() - start, "lines");
+	size_t naive_len = ftell(out);
+	fclose(out);
+	fclose(in);
+
+	in = fmemopen(input, length, "r");
+	out = fmemopen(bulk, output_size, "w");
+	start = bench_now();
+	uint64_t count = bulk_hash(in, out, ident_mode);
+	bench_report("bulk_hash", count, bench_now() - start, "lines");
+	size_t bulk_len = ftell(out);
+	fclose(out);
+	fclose(in);
+
+	if (count != num_lines || naive_len != bulk_len || memcmp(naive, bulk, naive_len) != 0) {
+		print_error("bulk hashing disagrees with hashing a line at a time", EXIT_FAILURE);
+	}
+
+	free(bulk);
+	free(naive);
+	free(input);
+}
+
+/**
+ * Runs the micro benchmarks
+ */
+void run_benchmark(jhash_args_t* args)
+{
+	bench_generation(args->charset, args->max_len);
+	bench_batch();
+	bench_bulk(args->charset, args->ident_mode);
+}
@@ -0,0 +1,197 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/bulk.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <jhash/batch.h>
+
+typedef struct bulk_buffers bulk_buffers_t;
+
+/**
+ * Everything a run needs, allocated once up front so that nothing is
+ * allocated per line
+ */
+struct bulk_buffers {
+	char input[BULK_BUFFER_SIZE+1]; /* room to terminate a final line without a newline */
+	char output[BULK_BUFFER_SIZE+32];
+	size_t output_len;
+	const char* lines[BULK_BATCH];
+	size_t lengths[BULK_BATCH];
+	batch_string_t strings[BULK_BATCH];
+	jhash_t hashes[BULK_BATCH];
+};
+
+/**
+ * Formats a hash the same as format_hash, returning its length
+ */
+static size_t bulk_format_hash(jhash_t hash, int ident_mode, char* out)
+{
+	char digits[16];
+	size_t num_digits = 0;
+	size_t length = 0;
+	if (ident_mode == HASH_HEXADECIMAL) {
+		do {
+			digits[num_digits++] = "0123456789abcdef"[hash & 0xf];
+			hash >>= 4;
+		} while (hash != 0);
+	} else {
+		int32_t value = (int32_t)hash;
+		uint32_t magnitude = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+		if (value < 0) {
+			out[length++] = '-';
+		}
+		do {
+			digits[num_digits++] = '0' + magnitude%10;
+			magnitude /= 10;
+		} while (magnitude != 0);
+	}
+	while (num_digits > 0) {
+		out[length++] = digits[--num_digits];
+	}
+	return length;
+}
+
+/**
+ * Writes out everything buffered so far
+ */
+static void bulk_flush(bulk_buffers_t* buffers, FILE* out)
+{
+	if (fwrite(buffers->output, 1, buffers->output_len, out) != buffers->output_len) {
+		print_error("unable to write hashes", EXIT_FAILURE);
+	}
+	buffers->output_len = 0;
+}
+
+/**
+ * Hashes a batch of lines and buffers a "hash<TAB>string" line for each.
+ * Lines too long for the batch kernel are hashed separately.
+ */
+static void bulk_hash_batch(bulk_buffers_t* buffers, size_t count, FILE* out, int ident_mode)
+{
+	jagex_hash_batch((const batch_string_t*)buffers->strings, count, buffers->hashes);
+	for (size_t i = 0; i < count; i++) {
+		size_t length = buffers->lengths[i];
+		if (length > BATCH_STRING_LEN) {
+			buffers->hashes[i] = jagex_hash(buffers->lines[i]);
+		}
+		if (sizeof(buffers->output) - buffers->output_len < length + 16) {
+			bulk_flush(buffers, out);
+		}
+		char* line = &buffers->output[buffers->output_len];
+		size_t hash_len = bulk_format_hash(buffers->hashes[i], ident_mode, line);
+		line[hash_len] = '\t';
+		memcpy(&line[hash_len+1], buffers->lines[i], length);
+		line[hash_len+1+length] = '\n';
+		buffers->output_len += hash_len + length + 2;
+	}
+}
+
+/**
+ * Hashes every line of in, writing "hash<TAB>string" lines to out in the
+ * same order. The input is read a buffer at a time and split in place, and
+ * the lines are hashed BULK_BATCH at a time. Returns the number of lines.
+ */
+uint64_t bulk_hash(FILE* in, FILE* out, int ident_mode)
+{
+	bulk_buffers_t* buffers = (bulk_buffers_t*)malloc(sizeof(bulk_buffers_t));
+	if (!buffers) {
+		print_error("unable to allocate buffers", EXIT_FAILURE);
+	}
+	buffers->output_len = 0;
+
+	uint64_t num_lines = 0;
+	size_t filled = 0;
+	bool eof = false;
+	while (!eof) {
+		size_t wanted = BULK_BUFFER_SIZE - filled;
+		if (wanted == 0) {
+			print_error("line too long to hash", EXIT_FAILURE);
+		}
+		size_t num_read = fread(&buffers->input[filled], 1, wanted, in);
+		if (num_read < wanted) {
+			if (ferror(in)) {
+				print_error("unable to read strings to hash", EXIT_FAILURE);
+			}
+			eof = true;
+		}
+		filled += num_read;
+
+		/* split off every complete line, and at the end whatever's left */
+		char* next = buffers->input;
+		char* end = &buffers->input[filled];
+		size_t count = 0;
+		while (next < end) {
+			char* newline = (char*)memchr(next, '\n', end - next);
+			if (!newline) {
+				if (!eof) {
+					break;
+				}
+				newline = end;
+			}
+			size_t length = newline - next;
+			if (length > 0 && next[length-1] == '\r') {
+				length--;
+			}
+			next[length] = '\0';
+
+			buffers->lines[count] = next;
+			buffers->lengths[count] = length;
+			memset(buffers->strings[count], 0, sizeof(batch_string_t));
+			memcpy(buffers->strings[count], next, length < BATCH_STRING_LEN ? length : BATCH_STRING_LEN);
+			if (++count == BULK_BATCH) {
+				bulk_hash_batch(buffers, count, out, ident_mode);
+				count = 0;
+			}
+			next = newline+1;
+			num_lines++;
+		}
+		bulk_hash_batch(buffers, count, out, ident_mode);
+
+		/* keep the partial line for the next read */
+		size_t consumed = (next < end) ? (size_t)(next - buffers->input) : filled;
+		memmove(buffers->input, &buffers->input[consumed], filled - consumed);
+		filled -= consumed;
+	}
+	bulk_flush(buffers, out);
+	if (fflush(out) != 0) {
+		print_error("unable to write hashes", EXIT_FAILURE);
+	}
+	free(buffers);
+	return num_lines;
+}
+
+/**
+ * Hashes every line of the strings file, or stdin
+ */
+void bulk_hash_file(jhash_args_t* args)
+{
+	FILE* fd = stdin;
+	if (strcmp(args->targets_path, "") != 0 && strcmp(args->targets_path, "-") != 0) {
+		fd = fopen(args->targets_path, "r");
+	}
+	if (!fd) {
+		char message[255];
+		sprintf(message, "%.200s: unable to read strings to hash", args->targets_path);
+		print_error(message, EXIT_FAILURE);
+	}
+	bulk_hash(fd, stdout, args->ident_mode);
+	if (fd != stdin) {
+		fclose(fd);
+	}
+}
@@ -0,0 +1,236 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/crack.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <jhash/jhash.h>
+#include <jhash/table.h>
+#include <jhash/keyspace.h>
+#include <jhash/rainbow.h>
+
+/**
+ * Outputs a match for a target, marking it found
+ */
+static void crack_report(void* data, jhash_t hash, const char* string)
+{
+	target_set_t* targets = (target_set_t*)data;
+	targets->found[target_set_find(targets, hash)] = true;
+	char hash_str[32];
+	format_hash(hash, hash_str);
+	printf("%s\t%.16s\n", hash_str, string);
+}
+
+/**
+ * Lookup a hash in a sorted table by way of its bucket directory
+ */
+static void lookup_sorted_table(table_map_t* map, jhash_t hash, crack_match_t match, void* data)
+{
+	/* find the bucket's bounds in the directory */
+	uint32_t bucket = table_bucket(hash, map->header.bucket_bits);
+	uint64_t low = map->directory[bucket];
+	uint64_t high = map->directory[bucket+1];
+	if (high < low || high > map->num_entries) {
+		print_error("corrupt table directory", EXIT_FAILURE);
+	}
+
+	/* binary search for the first match */
+	const table_entry_t* entries = map->entries;
+	while (low < high) {
+		uint64_t mid = low + (high - low)/2;
+		if ((uint32_t)entries[mid].hash < (uint32_t)hash) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	/* output every entry which collides */
+	for (uint64_t i = low; i < map->num_entries && entries[i].hash == hash; i++) {
+		match(data, hash, entries[i].string);
+	}
+}
+
+/**
+ * Lookup a hash in a compact table, rebuilding the strings from their ranks
+ */
+static void lookup_compact_table(table_map_t* map, jhash_t hash, crack_match_t match, void* data)
+{
+	uint32_t bucket_bits = map->header.bucket_bits;
+	uint32_t rank_bits = table_record_rank_bits(bucket_bits);
+	uint64_t hash_mask = (bucket_bits == 0) ? 0xffffffffULL : (1ULL << (32 - bucket_bits)) - 1;
+	uint64_t key = (uint32_t)hash & hash_mask;
+
+	/* find the bucket's bounds in the directory */
+	uint32_t bucket = table_bucket(hash, bucket_bits);
+	uint64_t low = map->directory[bucket];
+	uint64_t high = map->directory[bucket+1];
+	if (high < low || high > map->num_entries) {
+		print_error("corrupt table directory", EXIT_FAILURE);
+	}
+
+	/* binary search for the first match */
+	const table_record_t* records = map->records;
+	uint64_t end = high;
+	while (low < high) {
+		uint64_t mid = low + (high - low)/2;
+		if ((records[mid] >> rank_bits) < key) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	/* output every entry which collides */
+	uint64_t rank_mask = (1ULL << rank_bits) - 1;
+	for (uint64_t i = low; i < end && (records[i] >> rank_bits) == key; i++) {
+		char string[KEYSPACE_MAX_LENGTH+1];
+		keyspace_global_string(map->header.charset, records[i] & rank_mask, string);
+		match(data, hash, string);
+	}
+}
+
+/**
+ * Scan a hash only table once, rebuilding matching strings from their position
+ */
+static void scan_hashes_table(table_map_t* map, target_set_t* targets, crack_match_t match, void* data)
+{
+	const uint32_t* hashes = map->hashes;
+	for (uint64_t i = 0; i < map->num_entries; i++) {
+		if (target_set_contains(targets, hashes[i])) {
+			char string[KEYSPACE_MAX_LENGTH+1];
+			keyspace_global_string(map->header.charset, i, string);
+			match(data, hashes[i], string);
+		}
+	}
+}
+
+/**
+ * Scan an unsorted table once, matching every entry against every target
+ */
+static void scan_table(table_map_t* map, target_set_t* targets, crack_match_t match, void* data)
+{
+	const table_entry_t* entries = map->entries;
+	for (uint64_t i = 0; i < map->num_entries; i++) {
+		if (target_set_contains(targets, entries[i].hash)) {
+			match(data, entries[i].hash, entries[i].string);
+		}
+	}
+}
+
+/**
+ * Lookup every target in a table, by index if it has one or else in a single scan
+ */
+void crack_lookup_all(table_map_t* map, target_set_t* targets, crack_match_t match, void* data)
+{
+	switch (map->header.format) {
+	case TABLE_FORMAT_SORTED:
+		for (size_t i = 0; i < targets->count; i++) {
+			lookup_sorted_table(map, targets->targets[i], match, data);
+		}
+		break;
+	case TABLE_FORMAT_COMPACT:
+		for (size_t i = 0; i < targets->count; i++) {
+			lookup_compact_table(map, targets->targets[i], match, data);
+		}
+		break;
+	case TABLE_FORMAT_HASHES:
+		scan_hashes_table(map, targets, match, data);
+		break;
+	case TABLE_FORMAT_RAINBOW:
+		for (size_t i = 0; i < targets->count; i++) {
+			rainbow_lookup(map, targets->targets[i], match, data);
+		}
+		break;
+	default:
+		scan_table(map, targets, match, data);
+		break;
+	}
+}
+
+/**
+ * Loads the hashes to crack, either the one given or a list of them
+ */
+void crack_load_targets(jhash_args_t* args, target_set_t* targets)
+{
+	target_set_init(targets);
+	if (strcmp(args->targets_path, "") == 0) {
+		target_set_add(targets, args->target_hash);
+		return;
+	}
+
+	FILE* fd = stdin;
+	if (strcmp(args->targets_path, "-") != 0) {
+		fd = fopen(args->targets_path, "r");
+	}
+	if (!fd || !target_set_load(targets, fd, args->ident_mode)) {
+		char message[255];
+		sprintf(message, "%.200s: unable to read target hashes", args->targets_path);
+		print_error(message, EXIT_FAILURE);
+	}
+	if (fd != stdin) {
+		fclose(fd);
+	}
+
+	if (args->bloom_fp > 0 || args->bloom_kb > 0) {
+		target_set_build_filter(targets, args->bloom_fp, (size_t)args->bloom_kb*1024);
+		if (args->verbose) {
+			/* small filters, down to a single block, are reported in bytes */
+			unsigned long size = (unsigned long)((targets->bloom_mask+1)*TARGET_BLOOM_BLOCK_BITS/8);
+			bool in_kb = size >= 1024;
+			fprintf(stderr, "bloom filter of %lu%s, %d bits per target, %.3g%% false positives\n",
+				in_kb ? size/1024 : size, in_kb ? "kB" : " bytes", targets->bloom_hashes,
+				100*target_set_filter_rate(targets));
+		}
+	}
+}
+
+/**
+ * Lookup every target hash in a given table
+ */
+void crack_table(jhash_args_t* args)
+{
+	target_set_t targets;
+	crack_load_targets(args, &targets);
+
+	/* map the table */
+	table_map_t map;
+	if (!table_map_open(&map, args->table_path)) {
+		char message[255];
+		sprintf(message, "%.200s: unable to open table for reading", args->table_path);
+		print_error(message, EXIT_FAILURE);
+	}
+
+	/* sorted tables can be searched without a scan */
+	bool indexed = (map.header.format == TABLE_FORMAT_SORTED || map.header.format == TABLE_FORMAT_COMPACT ||
+		map.header.format == TABLE_FORMAT_RAINBOW);
+	table_map_advise(&map, indexed ? MADV_RANDOM : MADV_SEQUENTIAL);
+	crack_lookup_all(&map, &targets, crack_report, &targets);
+
+	for (size_t i = 0; i < targets.count; i++) {
+		jhash_t hash = targets.targets[i];
+		if (!targets.found[target_set_find(&targets, hash)]) {
+			fprintf(stderr, "unable to find result for %x (searched %lu)\n", hash, (unsigned long)map.num_entries);
+		}
+	}
+
+	target_set_free(&targets);
+	table_map_close(&map);
+}
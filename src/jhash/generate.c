@@ -0,0 +1,646 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/generate.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <jhash/table.h>
+#include <jhash/keyspace.h>
+#include <jhash/mask.h>
+#include <jhash/rainbow.h>
+
+#define GEN_NUM_BUFFER_SETS 2
+#define GEN_CHECKPOINT_MAGIC 0x5043484a /* "JHCP" */
+#define GEN_PROGRESS_INTERVAL 1.0 /* seconds between progress updates */
+
+typedef struct gen_worker gen_worker_t;
+typedef struct gen_checkpoint gen_checkpoint_t;
+typedef struct gen_writer gen_writer_t;
+typedef struct gen_progress gen_progress_t;
+
+/**
+ * Each worker enumerates a contiguous range of ranks into its own buffer
+ */
+struct gen_worker {
+	pthread_t thread;
+	const mask_t* mask; /* the strings of one length, or of the --mask */
+	uint64_t start;
+	uint64_t end;
+	bool hashes_only;
+	void* buffer; /* table_entry_t, or uint32_t hashes if hashes_only */
+};
+
+/**
+ * Records how many entries have safely reached the disk, so that an
+ * interrupted run can carry on from there with --resume
+ */
+struct gen_checkpoint {
+	uint32_t magic;
+	uint32_t format;
+	uint32_t max_len;
+	char charset[128];
+	uint32_t shard;
+	uint32_t num_shards;
+	uint64_t entries_written;
+};
+
+/**
+ * The writer thread flushes one round of worker buffers while the workers
+ * fill the other set. Only one round is ever handed over at a time, so once
+ * a submit returns the set submitted before it has been written.
+ */
+struct gen_writer {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	FILE* fd;
+	size_t entry_size;
+	const char* checkpoint_path;
+	gen_checkpoint_t checkpoint;
+	gen_worker_t* pending;
+	int num_pending;
+	bool writing;
+	bool finished;
+	bool failed;
+};
+
+struct gen_progress {
+	double start_time;
+	double last_report;
+	uint64_t start_entries;
+	uint64_t total_entries;
+};
+
+/**
+ * The ranks [start, end) of a length which belong to a shard. The bounds
+ * only depend on the keyspace size, so a shard can always be regenerated
+ * on its own.
+ */
+static void gen_shard_bounds(uint64_t total, int shard, int num_shards, uint64_t* start, uint64_t* end)
+{
+	uint64_t index = shard;
+	uint64_t size = total/num_shards;
+	uint64_t extra = total%num_shards; /* the first shards take one more each */
+	*start = size*index + (index < extra ? index : extra);
+	*end = *start + size + (index < extra);
+}
+
+/**
+ * Flush an array of table_entries (or hashes) to a file
+ */
+static bool flush_table_entries(FILE* fd, void* entries, size_t size, size_t num) {
+	return fwrite(entries, size, num, fd) == num;
+}
+
+/**
+ * Atomically replaces the checkpoint file
+ */
+static bool gen_checkpoint_save(const char* path, gen_checkpoint_t* checkpoint)
+{
+	char tmp_path[300];
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+		return false;
+	}
+	FILE* fd = fopen(tmp_path, "w");
+	if (!fd) {
+		return false;
+	}
+	bool success = fwrite(checkpoint, sizeof(gen_checkpoint_t), 1, fd) == 1;
+	success &= (fclose(fd) == 0);
+	return success && rename(tmp_path, path) == 0;
+}
+
+/**
+ * Reads a checkpoint file
+ */
+static bool gen_checkpoint_load(const char* path, gen_checkpoint_t* checkpoint)
+{
+	FILE* fd = fopen(path, "r");
+	if (!fd) {
+		return false;
+	}
+	bool success = fread(checkpoint, sizeof(gen_checkpoint_t), 1, fd) == 1 && checkpoint->magic == GEN_CHECKPOINT_MAGIC;
+	fclose(fd);
+	checkpoint->charset[sizeof(checkpoint->charset)-1] = '\0';
+	return success;
+}
+
+/**
+ * Seconds since some arbitrary point, for timing
+ */
+static double gen_now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec/1e9;
+}
+
+/**
+ * Prints a progress line, at most once every GEN_PROGRESS_INTERVAL unless final
+ */
+static void gen_progress_report(gen_progress_t* progress, int length, uint64_t generated, uint64_t bytes_written, bool final)
+{
+	double now = gen_now();
+	if (!final && now - progress->last_report < GEN_PROGRESS_INTERVAL) {
+		return;
+	}
+	progress->last_report = now;
+
+	double elapsed = now - progress->start_time;
+	double rate = elapsed > 0 ? (generated - progress->start_entries)/elapsed : 0;
+	uint64_t eta = rate > 0 ? (uint64_t)((progress->total_entries - generated)/rate) : 0;
+	fprintf(stderr, "\rlength %d, %5.1f%%, %.2fM candidates/sec, %luMB written, ETA %02lu:%02lu:%02lu%s",
+		length, 100.0*generated/progress->total_entries, rate/1e6, (unsigned long)(bytes_written >> 20),
+		(unsigned long)(eta/3600), (unsigned long)(eta/60%60), (unsigned long)(eta%60), final ? "\n" : "");
+}
+
+/**
+ * Writer thread entry point, flushes rounds in the order they're submitted
+ */
+static void* gen_writer_run(void* data)
+{
+	gen_writer_t* writer = (gen_writer_t*)data;
+	pthread_mutex_lock(&writer->lock);
+	while (true) {
+		while (writer->pending == NULL && !writer->finished) {
+			pthread_cond_wait(&writer->cond, &writer->lock);
+		}
+		if (writer->pending == NULL) {
+			break;
+		}
+
+		gen_worker_t* workers = writer->pending;
+		int num_workers = writer->num_pending;
+		writer->writing = true;
+		pthread_mutex_unlock(&writer->lock);
+
+		bool success = true;
+		uint64_t num_written = 0;
+		for (int i = 0; i < num_workers; i++) {
+			success &= flush_table_entries(writer->fd, workers[i].buffer, writer->entry_size, workers[i].end - workers[i].start);
+			num_written += workers[i].end - workers[i].start;
+		}
+
+		/* only checkpoint once the round is on disk */
+		success &= (fflush(writer->fd) == 0 && fdatasync(fileno(writer->fd)) == 0);
+		gen_checkpoint_t checkpoint = writer->checkpoint;
+		checkpoint.entries_written += num_written;
+		if (success) {
+			success = gen_checkpoint_save(writer->checkpoint_path, &checkpoint);
+		}
+
+		pthread_mutex_lock(&writer->lock);
+		writer->checkpoint = checkpoint;
+		writer->failed |= !success;
+		writer->writing = false;
+		writer->pending = NULL;
+		pthread_cond_broadcast(&writer->cond);
+	}
+	pthread_mutex_unlock(&writer->lock);
+	return NULL;
+}
+
+/**
+ * Starts the writer thread
+ */
+static void gen_writer_start(gen_writer_t* writer, FILE* fd, size_t entry_size, const char* checkpoint_path, gen_checkpoint_t* checkpoint)
+{
+	memset(writer, 0, sizeof(gen_writer_t));
+	writer->fd = fd;
+	writer->entry_size = entry_size;
+	writer->checkpoint_path = checkpoint_path;
+	writer->checkpoint = *checkpoint;
+	pthread_mutex_init(&writer->lock, NULL);
+	pthread_cond_init(&writer->cond, NULL);
+	if (pthread_create(&writer->thread, NULL, gen_writer_run, writer) != 0) {
+		print_error("unable to start writer thread", EXIT_FAILURE);
+	}
+}
+
+/**
+ * Hands a round to the writer, once it has finished the previous one.
+ * Returns the number of entries written so far.
+ */
+static uint64_t gen_writer_submit(gen_writer_t* writer, gen_worker_t* workers, int num_workers)
+{
+	pthread_mutex_lock(&writer->lock);
+	while (writer->pending != NULL || writer->writing) {
+		pthread_cond_wait(&writer->cond, &writer->lock);
+	}
+	writer->pending = workers;
+	writer->num_pending = num_workers;
+	uint64_t entries_written = writer->checkpoint.entries_written;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+	return entries_written;
+}
+
+/**
+ * Waits for everything to be written and stops the writer, returning false on a write error
+ */
+static bool gen_writer_finish(gen_writer_t* writer)
+{
+	pthread_mutex_lock(&writer->lock);
+	writer->finished = true;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+	pthread_join(writer->thread, NULL);
+
+	pthread_mutex_destroy(&writer->lock);
+	pthread_cond_destroy(&writer->cond);
+	return !writer->failed;
+}
+
+/**
+ * Worker thread entry point, generates the entries for [start, end)
+ */
+static void* gen_worker_run(void* data)
+{
+	gen_worker_t* worker = (gen_worker_t*)data;
+	keyspace_iter_t iter;
+	mask_iter_init(&iter, worker->mask, worker->start);
+	if (worker->hashes_only) {
+		uint32_t* hash = (uint32_t*)worker->buffer;
+		for (uint64_t rank = worker->start; rank < worker->end; rank++, hash++) {
+			*hash = (uint32_t)keyspace_iter_hash(&iter);
+			keyspace_iter_next(&iter);
+		}
+		return NULL;
+	}
+
+	table_entry_t* entry = (table_entry_t*)worker->buffer;
+	for (uint64_t rank = worker->start; rank < worker->end; rank++, entry++) {
+		memcpy(entry->string, iter.string, sizeof(entry->string));
+		entry->hash = keyspace_iter_hash(&iter);
+		keyspace_iter_next(&iter);
+	}
+	return NULL;
+}
+
+/**
+ * Hash only tables know their size up front, and are written with their header
+ */
+static bool gen_write_header(FILE* fd, jhash_args_t* args)
+{
+	table_header_t header;
+	table_header_init(&header, TABLE_FORMAT_HASHES, keyspace_offset(strlen(args->charset), args->max_len+1), args->charset, args->max_len);
+	return fseeko(fd, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(table_header_t), 1, fd) == 1;
+}
+
+/**
+ * Opens the table being generated. A fresh table is truncated, and a resumed
+ * table is cut back to the last checkpointed entry.
+ */
+static FILE* gen_open_table(jhash_args_t* args, const char* path, const char* checkpoint_path, gen_checkpoint_t* checkpoint, size_t entry_size)
+{
+	bool hashes_only = (entry_size == sizeof(uint32_t));
+	uint64_t data_offset = hashes_only ? sizeof(table_header_t) : 0;
+	memset(checkpoint, 0, sizeof(gen_checkpoint_t));
+	checkpoint->magic = GEN_CHECKPOINT_MAGIC;
+	checkpoint->format = args->table_format;
+	if (args->mask_spec != NULL) {
+		checkpoint->max_len = args->mask.length;
+		snprintf(checkpoint->charset, sizeof(checkpoint->charset), "?mask %08x", mask_fingerprint(&args->mask));
+	} else {
+		checkpoint->max_len = args->max_len;
+		snprintf(checkpoint->charset, sizeof(checkpoint->charset), "%s", args->charset);
+	}
+	checkpoint->shard = args->shard;
+	checkpoint->num_shards = args->num_shards;
+
+	if (args->resume) {
+		gen_checkpoint_t saved;
+		if (!gen_checkpoint_load(checkpoint_path, &saved)) {
+			print_error("no checkpoint to resume from", EXIT_FAILURE);
+		}
+		if (saved.format != checkpoint->format || saved.max_len != checkpoint->max_len ||
+				strcmp(saved.charset, checkpoint->charset) != 0 ||
+				saved.shard != checkpoint->shard || saved.num_shards != checkpoint->num_shards) {
+			print_error("checkpoint was made with different table options", EXIT_FAILURE);
+		}
+		checkpoint->entries_written = saved.entries_written;
+
+		/* the header is rewritten in case the table is being extended */
+		FILE* fd = fopen(path, "r+");
+		if (!fd || ftruncate(fileno(fd), data_offset + checkpoint->entries_written*entry_size) != 0 ||
+				(hashes_only && !gen_write_header(fd, args))) {
+			print_error("unable to reopen table to resume", EXIT_FAILURE);
+		}
+		fseeko(fd, 0, SEEK_END);
+		return fd;
+	}
+
+	FILE* fd = fopen(path, "w+");
+	if (!fd) {
+		char message[255];
+		sprintf(message, "%.200s: unable to open table for writing", args->table_path);
+		print_error(message, EXIT_FAILURE);
+	}
+
+	if (hashes_only && !gen_write_header(fd, args)) {
+		char message[255];
+		sprintf(message, "%.200s: unable to write table header", args->table_path);
+		print_error(message, EXIT_FAILURE);
+	}
+	if (fflush(fd) != 0 || !gen_checkpoint_save(checkpoint_path, checkpoint)) {
+		print_error("unable to write checkpoint", EXIT_FAILURE);
+	}
+	return fd;
+}
+
+/**
+ * Works out the maximum length of a legacy table, which has no header. Its
+ * charset isn't recorded either, so that comes from the command line, and
+ * the table has to be every string of it up to some length: the single
+ * characters in charset order first, and a size ending on a whole length.
+ */
+static bool gen_legacy_max_len(table_map_t* map, const char* charset, int* max_len)
+{
+	size_t charset_len = strlen(charset);
+	for (size_t i = 0; i < charset_len; i++) {
+		if (i >= map->num_entries || map->entries[i].string[0] != charset[i] || map->entries[i].string[1] != '\0') {
+			return false;
+		}
+	}
+	for (int length = 1; charset_len > 0 && length <= KEYSPACE_MAX_LENGTH; length++) {
+		if (keyspace_offset(charset_len, length+1) == map->num_entries) {
+			*max_len = length;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Resumes generating a table from the end of its existing lengths, by
+ * saving a checkpoint as if a run to the new maximum length had got there
+ */
+static void gen_extend_resume(jhash_args_t* args, const char* path, uint64_t entries_written)
+{
+	char checkpoint_path[300];
+	sprintf(checkpoint_path, "%s.checkpoint", path);
+	gen_checkpoint_t checkpoint;
+	memset(&checkpoint, 0, sizeof(gen_checkpoint_t));
+	checkpoint.magic = GEN_CHECKPOINT_MAGIC;
+	checkpoint.format = args->table_format;
+	checkpoint.max_len = args->max_len;
+	snprintf(checkpoint.charset, sizeof(checkpoint.charset), "%s", args->charset);
+	checkpoint.num_shards = 1;
+	checkpoint.entries_written = entries_written;
+	if (!gen_checkpoint_save(checkpoint_path, &checkpoint)) {
+		print_error("unable to write checkpoint", EXIT_FAILURE);
+	}
+	args->resume = true;
+	generate_table(args);
+}
+
+/**
+ * Extends a table to a longer maximum length, generating only the lengths
+ * it doesn't have. Legacy and hash only tables are in enumeration order, so
+ * the new lengths are simply appended. Sorted tables have the new lengths
+ * generated into a table of their own, which is merged in. Compact tables
+ * are unpacked back into a hash only table, appended to and packed again,
+ * all within the heap size. Legacy tables take their charset from the
+ * command line, as they don't record it.
+ */
+static void gen_extend_table(jhash_args_t* args)
+{
+	table_map_t map;
+	if (!table_map_open(&map, args->table_path)) {
+		char message[255];
+		sprintf(message, "%.200s: unable to open table to extend", args->table_path);
+		print_error(message, EXIT_FAILURE);
+	}
+
+	static char charset[sizeof(map.header.charset)];
+	int max_len = map.header.max_len;
+	int format = map.header.format;
+	bool valid = true;
+	if (format == TABLE_FORMAT_LEGACY) {
+		if (!args->max_len_given) {
+			table_map_close(&map);
+			print_error("legacy tables have no header, extending one needs -l, and -e if it's of the extended charset", EXIT_FAILURE);
+		}
+		snprintf(charset, sizeof(charset), "%s", args->charset);
+		valid = gen_legacy_max_len(&map, charset, &max_len);
+	} else {
+		strcpy(charset, map.header.charset);
+		valid = (format != TABLE_FORMAT_RAINBOW && charset[0] != '\0');
+	}
+	table_map_close(&map);
+	if (!valid) {
+		print_error("only whole tables generated from a charset can be extended", EXIT_FAILURE);
+	}
+	if (args->max_len <= max_len) {
+		print_error("table already covers the maximum length", EXIT_FAILURE);
+	}
+
+	jhash_args_t extension = *args;
+	extension.extend = false;
+	extension.charset = charset;
+	extension.table_format = format;
+	uint64_t entries_written = keyspace_offset(strlen(charset), max_len+1);
+
+	char path[255];
+	bool success = true;
+	switch (format) {
+	case TABLE_FORMAT_LEGACY:
+	case TABLE_FORMAT_HASHES:
+		gen_extend_resume(&extension, args->table_path, entries_written);
+		break;
+	case TABLE_FORMAT_COMPACT:
+		sprintf(path, "%.240s.unsorted", args->table_path);
+		if (!table_unpack_compact(args->table_path, path, args->heap_mb)) {
+			print_error("unable to unpack compact table", EXIT_FAILURE);
+		}
+		gen_extend_resume(&extension, path, entries_written);
+		break;
+	case TABLE_FORMAT_SORTED: {
+		char merged_path[300];
+		sprintf(path, "%.240s.extend", args->table_path);
+		sprintf(merged_path, "%.240s.merged", args->table_path);
+		strcpy(extension.table_path, path);
+		extension.min_len = max_len+1;
+		generate_table(&extension);
+
+		char* inputs[] = { args->table_path, path };
+		success = table_merge_sorted(inputs, 2, merged_path, args->heap_mb) && rename(merged_path, args->table_path) == 0;
+		unlink(path);
+		break;
+	}
+	}
+	if (!success) {
+		char message[255];
+		sprintf(message, "%.200s: unable to extend table", args->table_path);
+		print_error(message, EXIT_FAILURE);
+	}
+}
+
+/**
+ * Generate a lookup table
+ */
+void generate_table(jhash_args_t* args)
+{
+	if (args->table_format == TABLE_FORMAT_RAINBOW) {
+		rainbow_generate(args);
+		return;
+	}
+	if (args->extend) {
+		gen_extend_table(args);
+		return;
+	}
+
+	const char* table_path = args->table_path;
+	const char* charset = args->charset;
+	bool use_mask = (args->mask_spec != NULL);
+	int num_threads = args->threads;
+	int format = args->table_format;
+
+	/* sorted tables are generated unsorted first, then sorted into place.
+	 * compact tables are sorted from a hash only table */
+	char unsorted_path[255];
+	strcpy(unsorted_path, table_path);
+	if (format == TABLE_FORMAT_SORTED || format == TABLE_FORMAT_COMPACT) {
+		sprintf(unsorted_path, "%.240s.unsorted", table_path);
+	}
+	bool hashes_only = (format == TABLE_FORMAT_COMPACT || format == TABLE_FORMAT_HASHES);
+	size_t entry_size = hashes_only ? sizeof(uint32_t) : sizeof(table_entry_t);
+
+	/* open the table path */
+	char checkpoint_path[300];
+	sprintf(checkpoint_path, "%s.checkpoint", unsorted_path);
+	gen_checkpoint_t checkpoint;
+	FILE* fd = gen_open_table(args, unsorted_path, checkpoint_path, &checkpoint, entry_size);
+
+	/* split the heap between two sets of worker buffers */
+	size_t num_entries = ((size_t)args->heap_mb*1024*1024)/(size_t)(num_threads*GEN_NUM_BUFFER_SETS)/entry_size;
+	gen_worker_t workers[GEN_NUM_BUFFER_SETS][num_threads];
+	for (int set = 0; set < GEN_NUM_BUFFER_SETS; set++) {
+		for (int i = 0; i < num_threads; i++) {
+			workers[set][i].hashes_only = hashes_only;
+			workers[set][i].buffer = malloc(num_entries*entry_size);
+			if (!workers[set][i].buffer) {
+				print_error("unable to allocate table buffer", EXIT_FAILURE);
+			}
+		}
+	}
+
+	gen_writer_t writer;
+	gen_writer_start(&writer, fd, entry_size, checkpoint_path, &checkpoint);
+
+	gen_progress_t progress;
+	progress.start_time = progress.last_report = gen_now();
+	progress.start_entries = checkpoint.entries_written;
+	progress.total_entries = 0;
+	uint64_t generated = checkpoint.entries_written;
+	uint64_t skip = checkpoint.entries_written; /* already on disk from a previous run */
+
+	/* Generate the table, a round at a time, alternating between buffer
+	 * sets so that the previous round is written while this one is
+	 * generated. Buffers are flushed in rank order, so the output is
+	 * identical for any number of threads. A mask is generated as if it
+	 * were the only length, and a shard generates its slice of each length */
+	int set = 0;
+	int min_len = use_mask ? args->mask.length : args->min_len;
+	int max_len = use_mask ? args->mask.length : args->max_len;
+	mask_t masks[KEYSPACE_MAX_LENGTH+1];
+	uint64_t shard_start[KEYSPACE_MAX_LENGTH+1];
+	uint64_t shard_end[KEYSPACE_MAX_LENGTH+1];
+	for (int length = min_len; length <= max_len; length++) {
+		if (!use_mask) {
+			mask_from_charset(&masks[length], charset, length);
+		}
+		uint64_t total = mask_size(use_mask ? &args->mask : &masks[length]);
+		if (total == KEYSPACE_OVERFLOW) {
+			print_error("keyspace too large", EXIT_FAILURE);
+		}
+		gen_shard_bounds(total, args->shard, args->num_shards, &shard_start[length], &shard_end[length]);
+		progress.total_entries += shard_end[length] - shard_start[length];
+	}
+
+	for (int length = min_len; length <= max_len; length++) {
+		const mask_t* mask = use_mask ? &args->mask : &masks[length];
+		uint64_t end = shard_end[length];
+		if (skip >= end - shard_start[length]) {
+			skip -= end - shard_start[length];
+			continue;
+		}
+		uint64_t next = shard_start[length] + skip;
+		skip = 0;
+		while (next < end) {
+			int num_started = 0;
+			for (; num_started < num_threads && next < end; num_started++) {
+				gen_worker_t* worker = &workers[set][num_started];
+				worker->mask = mask;
+				worker->start = next;
+				worker->end = (end - next > num_entries) ? next + num_entries : end;
+				next = worker->end;
+				if (pthread_create(&worker->thread, NULL, gen_worker_run, worker) != 0) {
+					print_error("unable to start worker thread", EXIT_FAILURE);
+				}
+			}
+
+			for (int i = 0; i < num_started; i++) {
+				pthread_join(workers[set][i].thread, NULL);
+			}
+			generated += workers[set][num_started-1].end - workers[set][0].start;
+			uint64_t entries_written = gen_writer_submit(&writer, workers[set], num_started);
+			set = (set + 1) % GEN_NUM_BUFFER_SETS;
+
+			if (args->progress) {
+				gen_progress_report(&progress, length, generated, entries_written*entry_size, false);
+			}
+		}
+	}
+
+	bool written = gen_writer_finish(&writer);
+	for (set = 0; set < GEN_NUM_BUFFER_SETS; set++) {
+		for (int i = 0; i < num_threads; i++) {
+			free(workers[set][i].buffer);
+		}
+	}
+	written &= (fclose(fd) == 0);
+	if (!written) {
+		char message[255];
+		sprintf(message, "%.200s: unable to write table", table_path);
+		print_error(message, EXIT_FAILURE);
+	}
+	if (args->progress) {
+		gen_progress_report(&progress, max_len, generated, writer.checkpoint.entries_written*entry_size, true);
+	}
+
+	bool sorted = true;
+	if (format == TABLE_FORMAT_SORTED) {
+		sorted = table_sort_file(unsorted_path, table_path, use_mask ? "" : charset, max_len, args->heap_mb);
+	} else if (format == TABLE_FORMAT_COMPACT) {
+		sorted = table_sort_compact(unsorted_path, table_path, args->heap_mb);
+	}
+	if (!sorted) {
+		char message[255];
+		sprintf(message, "%.200s: unable to sort table", table_path);
+		print_error(message, EXIT_FAILURE);
+	}
+	if (strcmp(unsorted_path, table_path) != 0) {
+		unlink(unsorted_path);
+	}
+	unlink(checkpoint_path);
+}
@@ -19,6 +19,19 @@
 #include <err.h>
 #include <string.h>
 #include <jhash/args.h>
+#include <jhash/jhash.h>
+#include <jhash/table.h>
+#include <jhash/generate.h>
+#include <jhash/benchmark.h>
+#include <jhash/batch.h>
+#include <jhash/mitm.h>
+#include <jhash/crack.h>
+#include <jhash/serve.h>
+#include <jhash/attack.h>
+#include <jhash/wordlist.h>
+#include <jhash/rainbow.h>
+#include <jhash/merge.h>
+#include <jhash/bulk.h>
 
 extern char charset_std[];
 extern char charset_extd[];
@@ -29,18 +42,40 @@ extern char* program_invocation_name;
 jhash_args_t jhash_args = {
 	.mode = MODE_NONE,
 	.table_path = "",
+	.table_paths = NULL,
+	.num_table_paths = 0,
+	.socket_path = "",
 	.target_string = "",
+	.hash_strings = NULL,
+	.num_hash_strings = 0,
 	.target_hash = 0,
+	.targets_path = "",
 	.charset = charset_std,
+	.min_len = 1,
 	.max_len = 10,
+	.max_len_given = false,
 	.heap_mb = 256,
 	.verbose = false,
-	.ident_mode = HASH_HEXADECIMAL
+	.ident_mode = HASH_HEXADECIMAL,
+	.table_format = TABLE_FORMAT_LEGACY,
+	.threads = 1,
+	.resume = false,
+	.extend = false,
+	.progress = false,
+	.stop_on_found = false,
+	.bloom_fp = 0,
+	.bloom_kb = 0,
+	.mask_spec = NULL,
+	.wordlist_path = "",
+	.rules = NULL,
+	.num_rules = 0,
+	.chain_len = RAINBOW_DEFAULT_CHAIN_LEN,
+	.num_chains = RAINBOW_DEFAULT_CHAINS,
+	.shard = 0,
+	.num_shards = 1
 };
 
-static void hash(char* string);
-static void lookup_table(const char* table_path, jhash_t hash, unsigned int heap_mb);
-static void generate_table(const char* table_path, char* charset, int max_length, unsigned int heap_mb);
+static void hash(char** strings, int count);
 static void jhash_exit();
 
 /**
@@ -69,38 +104,53 @@ int main(int argc, char** argv) {
 		return EXIT_FAILURE;
 	}
 
+	batch_init();
+
 	switch (jhash_args.mode) {
 	case MODE_HASH:
-		hash(jhash_args.target_string);
+		if (jhash_args.num_hash_strings == 0) {
+			bulk_hash_file(&jhash_args);
+		} else {
+			hash(jhash_args.hash_strings, jhash_args.num_hash_strings);
+		}
 		break;
 	case MODE_GEN_TABLE:
-		generate_table(jhash_args.table_path, jhash_args.charset, jhash_args.max_len, jhash_args.heap_mb);
+		generate_table(&jhash_args);
 		break;
 	case MODE_CRACK:
-		lookup_table(jhash_args.table_path, jhash_args.target_hash, jhash_args.heap_mb);
+		crack_table(&jhash_args);
+		break;
+	case MODE_BENCHMARK:
+		run_benchmark(&jhash_args);
+		break;
+	case MODE_MITM:
+		crack_mitm(&jhash_args);
+		break;
+	case MODE_SERVE:
+		serve_tables(&jhash_args);
+		break;
+	case MODE_QUERY:
+		query_server(&jhash_args);
+		break;
+	case MODE_MERGE:
+		merge_tables(&jhash_args);
+		break;
+	case MODE_ATTACK:
+		if (strcmp(jhash_args.wordlist_path, "") != 0) {
+			crack_wordlist(&jhash_args);
+		} else {
+			crack_attack(&jhash_args);
+		}
 		break;
 	}
 
 	return EXIT_SUCCESS;
 }
 
-typedef struct table_entry table_entry_t;
-struct table_entry {
-	jhash_t hash;
-	char string[16];
-};
-
-/**
- * Flush an array of table_entries to a file
- */
-static void flush_table_entries(FILE* fd, table_entry_t* entries, int num) {
-	fwrite(entries, sizeof(table_entry_t), num, fd);
-}
-
 /**
  * Format a jhash_t for output
  */
-static void format_hash(jhash_t hash, char* out)
+void format_hash(jhash_t hash, char* out)
 {
 	switch (jhash_args.ident_mode) {
 	case HASH_DECIMAL:
@@ -113,124 +163,39 @@ static void format_hash(jhash_t hash, char* out)
 }
 
 /**
- * Calculate a hash for a string and output it
+ * Calculate the hashes for some strings and output them
  */
-static void hash(char* string)
+static void hash(char** strings, int count)
 {
-	jhash_t hash = jagex_hash(string);
-	char hash_str[32];
-	format_hash(hash, hash_str);
-	printf("%s\t%s\n", hash_str, string);
-}
-
-/**
- * Generate a lookup table
- */
-static void generate_table(const char* table_path, char* charset, int max_length, unsigned int heap_mb) {
-	/* open the table path */
-	FILE* fd = fopen(table_path, "w+");
-	if (!fd) {
-		char message[255];
-		sprintf(message, "%s: unable to open table for writing", table_path);
-		print_error(message, EXIT_FAILURE);
+	/* strings too long for the batch kernel are hashed separately */
+	batch_string_t* batch = (batch_string_t*)calloc(count, sizeof(batch_string_t));
+	jhash_t* hashes = (jhash_t*)malloc(count*sizeof(jhash_t));
+	if (count > 0 && (!batch || !hashes)) {
+		print_error("unable to allocate hashes", EXIT_FAILURE);
 	}
-
-	/* allocate memory to store the table in */
-	size_t num_entries = (size_t)(heap_mb*1024*1024)/(size_t)(sizeof(table_entry_t));
-	table_entry_t* entries = (table_entry_t*)malloc((size_t)sizeof(table_entry_t)*num_entries);
-	size_t cur_entry = 0;
-	memset(entries, 0, (size_t)sizeof(table_entry_t)*num_entries);
-
-	/* Generate the table */
-	for (int length = 1; length <= max_length; length++) {
-		/* Adapted from 'Jerome' @ stackoverflow (http://goo.gl/dvVArI) */
-		char* buffer[length];
-		int i;
-		for (i = 0; i < length; i++) {
-			buffer[i] = &charset[0];
+	for (int i = 0; i < count; i++) {
+		if (strlen(strings[i]) <= BATCH_STRING_LEN) {
+			strncpy(batch[i], strings[i], BATCH_STRING_LEN);
 		}
-		do {
-			/* store the previous result */
-			for (i = 0; i < length; i++) {
-				entries[cur_entry].string[i] = *buffer[i];
-			}
-			entries[cur_entry].hash = jagex_hash(entries[cur_entry].string);
-			/* If necessary flush to file, reset our buffer */
-			if (++cur_entry > num_entries) {
-				flush_table_entries(fd, entries, num_entries);
-				cur_entry = 0;
-				memset(entries, 0, (size_t)sizeof(table_entry_t)*num_entries);
-			}
-
-			/* calculate the next permutation */
-			for(i = 0; i < length && *(++buffer[i]) == '\0'; i++) {
-				buffer[i] = &charset[0];
-			}
-		} while (i < length);
 	}
+	jagex_hash_batch(batch, count, hashes);
 
-	/* flush and exit */
-	flush_table_entries(fd, entries, cur_entry);
-
-	free(entries);
-	fclose(fd);
-}
-
-/**
- * Lookup a hash in a given table
- */
-static void lookup_table(const char* table_path, jhash_t hash, unsigned int heap_mb)
-{
-	/* open the table path */
-	FILE* fd = fopen(table_path, "r");
-	if (!fd) {
-		char message[255];
-		sprintf(message, "%s: unable to open table for reading", table_path);
-		print_error(message, EXIT_FAILURE);
-	}
-
-	/* allocate memory to store the table in */
-	size_t num_entries = (size_t)(heap_mb*1024*1024)/(size_t)(sizeof(table_entry_t));
-	table_entry_t* entries = (table_entry_t*)malloc((size_t)sizeof(table_entry_t)*num_entries);
-	size_t entries_avail = 0;
-	fseek(fd, 0, SEEK_END);
-	size_t entries_total = ftell(fd)/sizeof(table_entry_t);
-	fseek(fd, 0, SEEK_SET);
-
-	bool success = false;
-	/* buffer, then search the table */
-	while (true) {
-		/* buffer, exiting on error/eof */
-		entries_avail = fread(entries, sizeof(table_entry_t), num_entries, fd);
-		if (entries_avail == 0) {
-			break;
-		}
-
-		/* lookup */
-		for (size_t i = 0; i < entries_avail; i++) {
-			if (entries[i].hash == hash) {
-				/* success! */
-				success = true;
-				char hash_str[32];
-				format_hash(hash, hash_str);
-				printf("%s\t%s\n", hash_str, entries[i].string);
-				break;
-			}
+	for (int i = 0; i < count; i++) {
+		if (strlen(strings[i]) > BATCH_STRING_LEN) {
+			hashes[i] = jagex_hash(strings[i]);
 		}
-		if (success) {
-			break;
-		}
-	}
-
-	if (!success) {
-		fprintf(stderr, "unable to find result for %x (searched %zu)\n", hash, entries_total);
+		char hash_str[32];
+		format_hash(hashes[i], hash_str);
+		printf("%s\t%s\n", hash_str, strings[i]);
 	}
 
-	free(entries);
-	fclose(fd);
+	free(hashes);
+	free(batch);
 }
 
 static void jhash_exit()
 {
-
+	free(jhash_args.hash_strings);
+	free(jhash_args.table_paths);
+	free(jhash_args.rules);
 }
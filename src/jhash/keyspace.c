@@ -0,0 +1,130 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/keyspace.h>
+
+#include <string.h>
+
+/**
+ * The number of strings of a given length, or KEYSPACE_OVERFLOW if it doesn't fit
+ */
+uint64_t keyspace_size(int charset_len, int length)
+{
+	uint64_t size = 1;
+	for (int i = 0; i < length; i++) {
+		if (size > KEYSPACE_OVERFLOW / charset_len) {
+			return KEYSPACE_OVERFLOW;
+		}
+		size *= charset_len;
+	}
+	return size;
+}
+
+/**
+ * Positions an enumeration buffer (one charset pointer per character) at a rank
+ */
+void keyspace_unrank(const char* charset, int length, uint64_t rank, const char** digits)
+{
+	uint64_t charset_len = strlen(charset);
+	for (int i = 0; i < length; i++) {
+		digits[i] = &charset[rank % charset_len];
+		rank /= charset_len;
+	}
+}
+
+/**
+ * Builds the string at a rank, null terminating it
+ */
+void keyspace_string(const char* charset, int length, uint64_t rank, char* out)
+{
+	uint64_t charset_len = strlen(charset);
+	for (int i = 0; i < length; i++) {
+		out[i] = charset[rank % charset_len];
+		rank /= charset_len;
+	}
+	out[length] = '\0';
+}
+
+/**
+ * The global rank of the first string of a length, ie. the number of strings
+ * of all shorter lengths (from 1)
+ */
+uint64_t keyspace_offset(int charset_len, int length)
+{
+	uint64_t offset = 0;
+	for (int i = 1; i < length; i++) {
+		offset += keyspace_size(charset_len, i);
+	}
+	return offset;
+}
+
+/**
+ * Builds the string at a global rank, returning its length
+ */
+int keyspace_global_string(const char* charset, uint64_t global_rank, char* out)
+{
+	int charset_len = strlen(charset);
+	int length = 1;
+	uint64_t size;
+	while (global_rank >= (size = keyspace_size(charset_len, length)) && length < KEYSPACE_MAX_LENGTH) {
+		global_rank -= size;
+		length++;
+	}
+	keyspace_string(charset, length, global_rank, out);
+	return length;
+}
+
+/**
+ * Positions an iterator at a rank, precalculating the per-character values
+ */
+void keyspace_iter_init(keyspace_iter_t* iter, const char* charset, int length, uint64_t rank)
+{
+	const char* charsets[KEYSPACE_MAX_LENGTH];
+	for (int i = 0; i < length; i++) {
+		charsets[i] = charset;
+	}
+	keyspace_iter_init_positions(iter, charsets, length, rank);
+}
+
+/**
+ * Positions an iterator with a charset per position at a rank
+ */
+void keyspace_iter_init_positions(keyspace_iter_t* iter, const char* const* charsets, int length, uint64_t rank)
+{
+	memset(iter, 0, sizeof(keyspace_iter_t));
+	iter->length = length;
+
+	uint32_t weight = 1;
+	for (int i = length-1; i >= 0; i--) {
+		iter->charsets[i] = charsets[i];
+		iter->radix[i] = strlen(charsets[i]);
+		for (int d = 0; d < iter->radix[i]; d++) {
+			char string[2] = { charsets[i][d], '\0' };
+			iter->term[i][d] = (uint32_t)jagex_hash(string)*weight;
+		}
+		weight *= 61;
+	}
+
+	for (int i = 0; i < length; i++) {
+		iter->digits[i] = rank % iter->radix[i];
+		rank /= iter->radix[i];
+		iter->string[i] = charsets[i][iter->digits[i]];
+	}
+	for (int i = length-1; i >= 0; i--) {
+		iter->partial[i] = iter->term[i][iter->digits[i]] + iter->partial[i+1];
+	}
+}
@@ -1,5 +1,5 @@
 JHASH_OUT = $(BIN_DIR)/jhash
-JHASH_OBJECTS = $(addprefix src/jhash/,jhash.o args.o)
+JHASH_OBJECTS = $(addprefix src/jhash/,jhash.o args.o table.o keyspace.o generate.o benchmark.o batch.o mitm.o targets.o crack.o serve.o mask.o attack.o wordlist.o rainbow.o merge.o bulk.o)
 
 TARGETS += $(JHASH_OUT)
 OBJECTS += $(JHASH_OBJECTS)
@@ -0,0 +1,174 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/mask.h>
+
+#include <string.h>
+
+static const char mask_upper[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static const char mask_lower[] = "abcdefghijklmnopqrstuvwxyz";
+static const char mask_digits[] = "0123456789";
+static const char mask_separators[] = " _-.";
+
+/**
+ * Appends the characters of src not already in a charset, returning false if it overflows
+ */
+static bool mask_append(char* charset, const char* src, size_t len)
+{
+	size_t charset_len = strlen(charset);
+	for (size_t i = 0; i < len; i++) {
+		if (memchr(charset, src[i], charset_len) != NULL) {
+			continue;
+		}
+		if (charset_len == MASK_MAX_CHARSET) {
+			return false;
+		}
+		charset[charset_len++] = src[i];
+		charset[charset_len] = '\0';
+	}
+	return true;
+}
+
+/**
+ * Appends the charset of a ? class, returning false if it's unknown. Custom
+ * charsets are only allowed at the top level, so that they can't recurse.
+ */
+static bool mask_append_class(char* out, char class, char* const* custom, const char* charset)
+{
+	switch (class) {
+	case 'u':
+		return mask_append(out, mask_upper, strlen(mask_upper));
+	case 'l':
+		return mask_append(out, mask_lower, strlen(mask_lower));
+	case 'd':
+		return mask_append(out, mask_digits, strlen(mask_digits));
+	case 's':
+		return mask_append(out, mask_separators, strlen(mask_separators));
+	case 'a':
+		return mask_append_class(out, 'u', NULL, charset) && mask_append_class(out, 'l', NULL, charset) &&
+			mask_append_class(out, 'd', NULL, charset) && mask_append_class(out, 's', NULL, charset);
+	case 'c':
+		return mask_append(out, charset, strlen(charset));
+	case '?':
+		return mask_append(out, "?", 1);
+	}
+
+	if (custom == NULL || class < '1' || class >= '1' + MASK_MAX_CUSTOM || custom[class - '1'] == NULL) {
+		return false;
+	}
+	const char* def = custom[class - '1'];
+	for (; *def != '\0'; def++) {
+		if (*def == '?') {
+			if (!mask_append_class(out, *++def, NULL, charset)) {
+				return false;
+			}
+		} else if (!mask_append(out, def, 1)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Parses a mask spec, with up to MASK_MAX_CUSTOM custom charsets (NULL if
+ * unset). Returns false if the spec is malformed, empty or too long.
+ */
+bool mask_parse(mask_t* mask, const char* spec, char* const* custom, const char* charset)
+{
+	memset(mask, 0, sizeof(mask_t));
+	for (; *spec != '\0'; spec++) {
+		if (mask->length == KEYSPACE_MAX_LENGTH) {
+			return false;
+		}
+		char* out = mask->charsets[mask->length];
+		if (*spec == '?') {
+			if (!mask_append_class(out, *++spec, custom, charset) || out[0] == '\0') {
+				return false;
+			}
+		} else {
+			mask_append(out, spec, 1);
+		}
+		mask->positions[mask->length] = out;
+		mask->length++;
+	}
+	return mask->length > 0;
+}
+
+/**
+ * Builds the mask for every string of a length over a charset
+ */
+void mask_from_charset(mask_t* mask, const char* charset, int length)
+{
+	mask->length = length;
+	for (int i = 0; i < length; i++) {
+		mask->positions[i] = charset;
+	}
+}
+
+/**
+ * The number of strings matching a mask, or KEYSPACE_OVERFLOW if it doesn't fit
+ */
+uint64_t mask_size(const mask_t* mask)
+{
+	uint64_t size = 1;
+	for (int i = 0; i < mask->length; i++) {
+		uint64_t radix = strlen(mask->positions[i]);
+		if (size > KEYSPACE_OVERFLOW / radix) {
+			return KEYSPACE_OVERFLOW;
+		}
+		size *= radix;
+	}
+	return size;
+}
+
+/**
+ * Builds the string at a rank, null terminating it
+ */
+void mask_string(const mask_t* mask, uint64_t rank, char* out)
+{
+	for (int i = 0; i < mask->length; i++) {
+		uint64_t radix = strlen(mask->positions[i]);
+		out[i] = mask->positions[i][rank % radix];
+		rank /= radix;
+	}
+	out[mask->length] = '\0';
+}
+
+/**
+ * A hash (FNV-1a) of the expanded charsets, to tell whether two masks enumerate the same strings
+ */
+uint32_t mask_fingerprint(const mask_t* mask)
+{
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < mask->length; i++) {
+		for (const char* c = mask->positions[i]; ; c++) {
+			hash = (hash ^ (uint8_t)*c)*16777619u;
+			if (*c == '\0') {
+				break;
+			}
+		}
+	}
+	return hash;
+}
+
+/**
+ * Positions an iterator over a mask at a rank
+ */
+void mask_iter_init(keyspace_iter_t* iter, const mask_t* mask, uint64_t rank)
+{
+	keyspace_iter_init_positions(iter, mask->positions, mask->length, rank);
+}
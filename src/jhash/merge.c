@@ -0,0 +1,187 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/merge.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <jhash/keyspace.h>
+#include <jhash/table.h>
+
+/**
+ * Tables are combined by concatenating their entries in the order given,
+ * into a legacy table or, sorted, into a sorted table. Sorted inputs are
+ * merged straight into a sorted table rather than being sorted again.
+ */
+
+typedef struct merge_contents merge_contents_t;
+
+/**
+ * What a sorted table made from the inputs holds, which the inputs are
+ * checked against: between them they must be every string of it. Legacy
+ * tables have no header, so this comes from the command line rather than
+ * from their entries.
+ */
+struct merge_contents {
+	const char* charset; /* empty for a mask table */
+	int max_len;
+	uint64_t num_entries;
+	bool allowed[256]; /* the characters of the charset */
+	uint64_t num_seen;
+	bool matches;
+};
+
+/**
+ * Fills in what the merged table holds
+ */
+static void merge_contents_init(merge_contents_t* contents, const char* charset, int max_len, uint64_t num_entries)
+{
+	memset(contents, 0, sizeof(merge_contents_t));
+	contents->charset = charset;
+	contents->max_len = max_len;
+	contents->num_entries = num_entries;
+	for (const char* c = charset; *c != '\0'; c++) {
+		contents->allowed[(unsigned char)*c] = true;
+	}
+	contents->matches = true;
+}
+
+/**
+ * Whether a table's entries all belong in the merged table
+ */
+static bool merge_table_matches(merge_contents_t* contents, table_map_t* map)
+{
+	if (map->header.format == TABLE_FORMAT_SORTED) {
+		return strcmp(map->header.charset, contents->charset) == 0 && (int)map->header.max_len <= contents->max_len;
+	}
+	for (uint64_t i = 0; i < map->num_entries; i++) {
+		const char* string = map->entries[i].string;
+		int length = strnlen(string, sizeof(map->entries[i].string));
+		if (length > contents->max_len) {
+			return false;
+		}
+		for (int j = 0; contents->charset[0] != '\0' && j < length; j++) {
+			if (!contents->allowed[(unsigned char)string[j]]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Appends the entries of every input table to a file, checking they belong
+ * in the merged table if there's a header to make for it
+ */
+static bool merge_concatenate(char** in_paths, int num_inputs, FILE* out, merge_contents_t* contents)
+{
+	for (int i = 0; i < num_inputs; i++) {
+		table_map_t map;
+		if (!table_map_open(&map, in_paths[i])) {
+			return false;
+		}
+		table_map_advise(&map, MADV_SEQUENTIAL);
+		bool success = (map.header.format == TABLE_FORMAT_LEGACY || map.header.format == TABLE_FORMAT_SORTED) &&
+			fwrite(map.entries, sizeof(table_entry_t), map.num_entries, out) == map.num_entries;
+		if (success && contents != NULL) {
+			contents->matches &= merge_table_matches(contents, &map);
+			contents->num_seen += map.num_entries;
+		}
+		table_map_close(&map);
+		if (!success) {
+			return false;
+		}
+	}
+	if (contents != NULL) {
+		contents->matches &= (contents->num_seen == contents->num_entries);
+	}
+	return true;
+}
+
+/**
+ * Whether every input table is sorted
+ */
+static bool merge_inputs_sorted(char** in_paths, int num_inputs)
+{
+	for (int i = 0; i < num_inputs; i++) {
+		table_map_t map;
+		if (!table_map_open(&map, in_paths[i])) {
+			return false;
+		}
+		bool sorted = (map.header.format == TABLE_FORMAT_SORTED);
+		table_map_close(&map);
+		if (!sorted) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Combine lookup tables into one
+ */
+void merge_tables(jhash_args_t* args)
+{
+	bool success;
+	if (args->table_format == TABLE_FORMAT_SORTED && merge_inputs_sorted(args->table_paths, args->num_table_paths)) {
+		success = table_merge_sorted(args->table_paths, args->num_table_paths, args->table_path, args->heap_mb);
+	} else if (args->table_format == TABLE_FORMAT_SORTED) {
+		/* legacy tables don't say what they hold, so the command line has to */
+		bool use_mask = (args->mask_spec != NULL);
+		if (!use_mask && !args->max_len_given) {
+			print_error("legacy tables have no header, merging them into a sorted table needs -l, "
+				"and -e if they're of the extended charset", EXIT_FAILURE);
+		}
+		merge_contents_t contents;
+		if (use_mask) {
+			merge_contents_init(&contents, "", args->mask.length, mask_size(&args->mask));
+		} else {
+			merge_contents_init(&contents, args->charset, args->max_len, keyspace_offset(strlen(args->charset), args->max_len+1));
+		}
+
+		char unsorted_path[255];
+		sprintf(unsorted_path, "%.240s.unsorted", args->table_path);
+		FILE* out = fopen(unsorted_path, "w");
+		success = (out != NULL) && merge_concatenate(args->table_paths, args->num_table_paths, out, &contents);
+		if (out) {
+			success = (fclose(out) == 0) && success;
+		}
+		if (success && !contents.matches) {
+			unlink(unsorted_path);
+			print_error("tables aren't every string of the charset and maximum length given", EXIT_FAILURE);
+		}
+		if (success) {
+			success = table_sort_file(unsorted_path, args->table_path, contents.charset, contents.max_len, args->heap_mb);
+		}
+		unlink(unsorted_path);
+	} else {
+		FILE* out = fopen(args->table_path, "w");
+		success = (out != NULL) && merge_concatenate(args->table_paths, args->num_table_paths, out, NULL);
+		if (out) {
+			success = (fclose(out) == 0) && success;
+		}
+	}
+
+	if (!success) {
+		char message[255];
+		sprintf(message, "%.200s: unable to merge tables", args->table_path);
+		print_error(message, EXIT_FAILURE);
+	}
+}
@@ -0,0 +1,227 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/mitm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jhash/jhash.h>
+#include <jhash/keyspace.h>
+
+/**
+ * The hash is linear mod 2^32, so for any split of a string,
+ * hash(prefix+suffix) = hash(prefix)*61^|suffix| + hash(suffix). We keep
+ * every suffix of one length in memory, sorted by hash, then sweep the
+ * prefixes looking up the suffix hash each one needs to reach the target.
+ */
+
+typedef struct mitm_suffix mitm_suffix_t;
+typedef struct mitm_table mitm_table_t;
+
+struct mitm_suffix {
+	uint32_t hash;
+	uint32_t rank;
+};
+
+struct mitm_table {
+	int length;
+	uint32_t bucket_bits;
+	mitm_suffix_t* suffixes;
+	uint32_t* directory; /* (1 << bucket_bits) + 1 suffix indices */
+};
+
+/**
+ * A directory of around one bucket per suffix
+ */
+static uint32_t mitm_bucket_bits(uint64_t num_suffixes)
+{
+	uint32_t bits = 0;
+	while (bits < MITM_MAX_BUCKET_BITS && (1ULL << bits) < num_suffixes) {
+		bits++;
+	}
+	return bits;
+}
+
+/**
+ * The memory needed for a table of num_suffixes
+ */
+static uint64_t mitm_table_size(uint64_t num_suffixes)
+{
+	return num_suffixes*sizeof(mitm_suffix_t) + ((1ULL << mitm_bucket_bits(num_suffixes))+1)*sizeof(uint32_t);
+}
+
+/**
+ * The bucket of a hash in the directory
+ */
+static uint32_t mitm_bucket(uint32_t hash, uint32_t bucket_bits)
+{
+	return bucket_bits == 0 ? 0 : hash >> (32 - bucket_bits);
+}
+
+/**
+ * qsort comparator ordering suffixes by hash, then rank
+ */
+static int mitm_suffix_compare(const void* a, const void* b)
+{
+	const mitm_suffix_t* suffix_a = (const mitm_suffix_t*)a;
+	const mitm_suffix_t* suffix_b = (const mitm_suffix_t*)b;
+	if (suffix_a->hash != suffix_b->hash) {
+		return suffix_a->hash < suffix_b->hash ? -1 : 1;
+	}
+	return suffix_a->rank < suffix_b->rank ? -1 : (suffix_a->rank > suffix_b->rank);
+}
+
+/**
+ * Builds the table of every suffix of a given length
+ */
+static void mitm_table_build(mitm_table_t* table, const char* charset, int length, uint64_t num_suffixes)
+{
+	table->length = length;
+	table->bucket_bits = mitm_bucket_bits(num_suffixes);
+	table->suffixes = (mitm_suffix_t*)malloc(num_suffixes*sizeof(mitm_suffix_t));
+	table->directory = (uint32_t*)malloc(((1ULL << table->bucket_bits)+1)*sizeof(uint32_t));
+	if (!table->suffixes || !table->directory) {
+		print_error("unable to allocate suffix table", EXIT_FAILURE);
+	}
+
+	keyspace_iter_t iter;
+	keyspace_iter_init(&iter, charset, length, 0);
+	for (uint64_t rank = 0; rank < num_suffixes; rank++) {
+		table->suffixes[rank].hash = (uint32_t)keyspace_iter_hash(&iter);
+		table->suffixes[rank].rank = rank;
+		keyspace_iter_next(&iter);
+	}
+	qsort(table->suffixes, num_suffixes, sizeof(mitm_suffix_t), mitm_suffix_compare);
+
+	uint64_t num_buckets = (1ULL << table->bucket_bits);
+	uint64_t suffix = 0;
+	for (uint64_t bucket = 0; bucket <= num_buckets; bucket++) {
+		while (suffix < num_suffixes && mitm_bucket(table->suffixes[suffix].hash, table->bucket_bits) < bucket) {
+			suffix++;
+		}
+		table->directory[bucket] = suffix;
+	}
+}
+
+/**
+ * Outputs a preimage of the target
+ */
+static void mitm_report(jhash_t target, const char* prefix, int prefix_len, const char* suffix)
+{
+	char hash_str[32];
+	format_hash(target, hash_str);
+	printf("%s\t%.*s%s\n", hash_str, prefix_len, prefix, suffix);
+}
+
+/**
+ * Sweeps the prefixes of each length longer than the suffix table, returning the number of preimages found
+ */
+static uint64_t mitm_sweep(jhash_args_t* args, int suffix_len, uint64_t num_suffixes)
+{
+	const char* charset = args->charset;
+	uint32_t target = (uint32_t)args->target_hash;
+	uint64_t found = 0;
+
+	mitm_table_t table;
+	mitm_table_build(&table, charset, suffix_len, num_suffixes);
+
+	uint32_t multiplier = 1;
+	for (int i = 0; i < suffix_len; i++) {
+		multiplier *= 61;
+	}
+
+	for (int length = suffix_len+1; length <= args->max_len; length++) {
+		int prefix_len = length - suffix_len;
+		keyspace_iter_t iter;
+		keyspace_iter_init(&iter, charset, prefix_len, 0);
+		do {
+			uint32_t needed = target - (uint32_t)keyspace_iter_hash(&iter)*multiplier;
+			uint32_t bucket = mitm_bucket(needed, table.bucket_bits);
+			for (uint32_t i = table.directory[bucket]; i < table.directory[bucket+1]; i++) {
+				if (table.suffixes[i].hash < needed) {
+					continue;
+				} else if (table.suffixes[i].hash > needed) {
+					break;
+				}
+				char suffix[KEYSPACE_MAX_LENGTH+1];
+				keyspace_string(charset, suffix_len, table.suffixes[i].rank, suffix);
+				mitm_report(args->target_hash, iter.string, prefix_len, suffix);
+				found++;
+			}
+		} while (keyspace_iter_next(&iter));
+	}
+
+	free(table.directory);
+	free(table.suffixes);
+
+	return found;
+}
+
+/**
+ * Cracks a hash without a lookup table, reporting every preimage up to max_len
+ */
+void crack_mitm(jhash_args_t* args)
+{
+	const char* charset = args->charset;
+	int charset_len = strlen(charset);
+	uint32_t target = (uint32_t)args->target_hash;
+	uint64_t heap = (uint64_t)args->heap_mb*1024*1024;
+
+	/* pick the longest suffix whose table fits in the heap */
+	int suffix_len = 0;
+	uint64_t num_suffixes = 1;
+	while (suffix_len < args->max_len) {
+		uint64_t next = num_suffixes*charset_len;
+		if (next > UINT32_MAX || mitm_table_size(next) > heap) {
+			break;
+		}
+		num_suffixes = next;
+		suffix_len++;
+	}
+	if (suffix_len == 0) {
+		print_error("heap too small for a suffix table", EXIT_FAILURE);
+	}
+
+	if (args->verbose) {
+		fprintf(stderr, "suffix length %d, %lu suffixes (%lu MB)\n", suffix_len,
+			(unsigned long)num_suffixes, (unsigned long)(mitm_table_size(num_suffixes) >> 20));
+	}
+
+	/* strings no longer than the suffix are simply enumerated */
+	uint64_t found = 0;
+	for (int length = 1; length <= suffix_len; length++) {
+		keyspace_iter_t iter;
+		keyspace_iter_init(&iter, charset, length, 0);
+		do {
+			if ((uint32_t)keyspace_iter_hash(&iter) == target) {
+				mitm_report(args->target_hash, iter.string, length, "");
+				found++;
+			}
+		} while (keyspace_iter_next(&iter));
+	}
+
+	if (suffix_len < args->max_len) {
+		found += mitm_sweep(args, suffix_len, num_suffixes);
+	}
+
+	if (found == 0) {
+		fprintf(stderr, "unable to find result for %x\n", target);
+	} else if (args->verbose) {
+		fprintf(stderr, "%lu results\n", (unsigned long)found);
+	}
+}
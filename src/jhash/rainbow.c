@@ -0,0 +1,287 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/rainbow.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <jhash/keyspace.h>
+
+/**
+ * A rainbow chain walks the keyspace of every string from length 1 to
+ * max_len, by global rank. Step i hashes the current string and reduces
+ * the hash to the next rank with R_i(h) = mix(i << 32 | h) % size, where
+ * mix scrambles the bits so that a reduction is close to uniform. Only the
+ * start and end rank of each chain are kept, sorted by end.
+ *
+ * To find a hash we suppose it occurs at each step p in turn, reduce and
+ * walk it on to the end of a chain, and look the end up. A hit is only a
+ * candidate, since chains can merge, so the chain is walked again from
+ * its start to find the string. A lookup costs about chain_len^2/2 hashes.
+ */
+
+typedef struct rainbow_keyspace rainbow_keyspace_t;
+typedef struct rainbow_state rainbow_state_t;
+
+struct rainbow_keyspace {
+	int charset_len;
+	int max_len;
+	uint64_t size;
+	uint64_t offsets[KEYSPACE_MAX_LENGTH+2]; /* global rank of the first string of each length */
+	uint32_t value[256];
+};
+
+struct rainbow_state {
+	rainbow_keyspace_t keyspace;
+	table_chain_t* chains;
+	uint64_t num_chains;
+	uint64_t chain_len;
+	uint64_t next; /* the next unclaimed chain */
+	uint64_t done;
+};
+
+/**
+ * Precalculates the offsets and character values of a keyspace,
+ * returning false if it's empty or too large to rank
+ */
+static bool rainbow_keyspace_init(rainbow_keyspace_t* keyspace, const char* charset, int max_len)
+{
+	memset(keyspace, 0, sizeof(rainbow_keyspace_t));
+	if (max_len < 1 || max_len > KEYSPACE_MAX_LENGTH || charset[0] == '\0') {
+		return false;
+	}
+	keyspace->charset_len = strlen(charset);
+	keyspace->max_len = max_len;
+	for (int i = 0; i < keyspace->charset_len; i++) {
+		char string[2] = { charset[i], '\0' };
+		keyspace->value[i] = (uint32_t)jagex_hash(string);
+	}
+	for (int length = 1; length <= max_len+1; length++) {
+		keyspace->offsets[length] = keyspace_offset(keyspace->charset_len, length);
+	}
+	keyspace->size = keyspace->offsets[max_len+1];
+	uint64_t longest = keyspace_size(keyspace->charset_len, max_len);
+	return longest != KEYSPACE_OVERFLOW && keyspace->offsets[max_len] <= KEYSPACE_OVERFLOW - longest;
+}
+
+/**
+ * Hashes the string at a global rank, without building it
+ */
+static inline uint32_t rainbow_hash(rainbow_keyspace_t* keyspace, uint64_t rank)
+{
+	int length = 1;
+	while (rank >= keyspace->offsets[length+1]) {
+		length++;
+	}
+	rank -= keyspace->offsets[length];
+
+	uint32_t hash = 0;
+	for (int i = 0; i < length; i++) {
+		hash = hash*61 + keyspace->value[rank % keyspace->charset_len];
+		rank /= keyspace->charset_len;
+	}
+	return hash;
+}
+
+/**
+ * Scrambles the bits of a value (the splitmix64 finalizer)
+ */
+static inline uint64_t rainbow_mix(uint64_t x)
+{
+	x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27))*0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/**
+ * The reduction of a step, mapping a hash back into the keyspace
+ */
+static inline uint64_t rainbow_reduce(rainbow_keyspace_t* keyspace, uint64_t step, uint32_t hash)
+{
+	return rainbow_mix((step << 32) | hash) % keyspace->size;
+}
+
+/**
+ * Walks a chain from a rank at a step to its end
+ */
+static uint64_t rainbow_walk(rainbow_keyspace_t* keyspace, uint64_t rank, uint64_t step, uint64_t chain_len)
+{
+	for (; step < chain_len; step++) {
+		rank = rainbow_reduce(keyspace, step, rainbow_hash(keyspace, rank));
+	}
+	return rank;
+}
+
+/**
+ * Worker thread entry point, builds blocks of chains until there are none left
+ */
+static void* rainbow_worker_run(void* data)
+{
+	rainbow_state_t* state = (rainbow_state_t*)data;
+	while (true) {
+		uint64_t start = __atomic_fetch_add(&state->next, RAINBOW_BLOCK_SIZE, __ATOMIC_RELAXED);
+		if (start >= state->num_chains) {
+			break;
+		}
+		uint64_t end = (state->num_chains - start > RAINBOW_BLOCK_SIZE) ? start + RAINBOW_BLOCK_SIZE : state->num_chains;
+		for (uint64_t i = start; i < end; i++) {
+			table_chain_t* chain = &state->chains[i];
+			chain->start = rainbow_mix(i ^ 0x9e3779b97f4a7c15ULL) % state->keyspace.size;
+			chain->end = rainbow_walk(&state->keyspace, chain->start, 0, state->chain_len);
+		}
+		__atomic_fetch_add(&state->done, end - start, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+/**
+ * qsort comparator ordering chains by end, then start
+ */
+static int rainbow_chain_compare(const void* a, const void* b)
+{
+	const table_chain_t* chain_a = (const table_chain_t*)a;
+	const table_chain_t* chain_b = (const table_chain_t*)b;
+	if (chain_a->end != chain_b->end) {
+		return chain_a->end < chain_b->end ? -1 : 1;
+	}
+	return chain_a->start < chain_b->start ? -1 : (chain_a->start > chain_b->start);
+}
+
+/**
+ * Generate a rainbow table
+ */
+void rainbow_generate(jhash_args_t* args)
+{
+	rainbow_state_t state;
+	memset(&state, 0, sizeof(rainbow_state_t));
+	if (!rainbow_keyspace_init(&state.keyspace, args->charset, args->max_len)) {
+		print_error("keyspace too large", EXIT_FAILURE);
+	}
+	state.num_chains = args->num_chains;
+	state.chain_len = args->chain_len;
+	if (state.num_chains > ((uint64_t)args->heap_mb*1024*1024)/sizeof(table_chain_t)) {
+		print_error("too many chains for the heap size", EXIT_FAILURE);
+	}
+	state.chains = (table_chain_t*)malloc(state.num_chains*sizeof(table_chain_t));
+	if (!state.chains) {
+		print_error("unable to allocate chains", EXIT_FAILURE);
+	}
+
+	/* every chain is written to its own slot, so the output doesn't depend on the thread count */
+	int num_threads = args->threads;
+	pthread_t threads[num_threads];
+	for (int i = 0; i < num_threads; i++) {
+		if (pthread_create(&threads[i], NULL, rainbow_worker_run, &state) != 0) {
+			print_error("unable to start worker thread", EXIT_FAILURE);
+		}
+	}
+	while (args->progress && __atomic_load_n(&state.done, __ATOMIC_RELAXED) < state.num_chains) {
+		sleep(1);
+		fprintf(stderr, "\r%5.1f%% of chains built", 100.0*__atomic_load_n(&state.done, __ATOMIC_RELAXED)/state.num_chains);
+	}
+	for (int i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	if (args->progress) {
+		fprintf(stderr, "\n");
+	}
+
+	/* chains which end together have merged, so only one of them is worth keeping */
+	qsort(state.chains, state.num_chains, sizeof(table_chain_t), rainbow_chain_compare);
+	uint64_t num_unique = 0;
+	for (uint64_t i = 0; i < state.num_chains; i++) {
+		if (num_unique == 0 || state.chains[i].end != state.chains[num_unique-1].end) {
+			state.chains[num_unique++] = state.chains[i];
+		}
+	}
+
+	table_header_t header;
+	table_header_init(&header, TABLE_FORMAT_RAINBOW, num_unique, args->charset, args->max_len);
+	FILE* fd = fopen(args->table_path, "w");
+	bool success = (fd != NULL);
+	if (success) {
+		success = fwrite(&header, sizeof(table_header_t), 1, fd) == 1 &&
+			fwrite(&state.chain_len, sizeof(uint64_t), 1, fd) == 1 &&
+			fwrite(state.chains, sizeof(table_chain_t), num_unique, fd) == num_unique;
+		success &= (fclose(fd) == 0);
+	}
+	free(state.chains);
+	if (!success) {
+		char message[255];
+		sprintf(message, "%.200s: unable to write table", args->table_path);
+		print_error(message, EXIT_FAILURE);
+	}
+}
+
+/**
+ * Lookup a hash in a rainbow table, trying each step of the chains in turn
+ */
+void rainbow_lookup(table_map_t* map, jhash_t hash, crack_match_t match, void* data)
+{
+	rainbow_keyspace_t keyspace;
+	if (!rainbow_keyspace_init(&keyspace, map->header.charset, map->header.max_len)) {
+		print_error("corrupt rainbow table", EXIT_FAILURE);
+	}
+
+	/* a string can turn up at several steps, so the ranks found are kept to only output it once */
+	uint64_t* found = NULL;
+	size_t num_found = 0;
+
+	uint64_t chain_len = map->chain_len;
+	for (uint64_t step = 0; step < chain_len; step++) {
+		uint64_t end = rainbow_walk(&keyspace, rainbow_reduce(&keyspace, step, (uint32_t)hash), step+1, chain_len);
+
+		/* binary search for the chain ending there */
+		uint64_t low = 0;
+		uint64_t high = map->num_entries;
+		while (low < high) {
+			uint64_t mid = low + (high - low)/2;
+			if (map->chains[mid].end < end) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		if (low == map->num_entries || map->chains[low].end != end) {
+			continue;
+		}
+
+		/* walk the chain to the step, to see whether it really passes through the hash */
+		uint64_t rank = map->chains[low].start;
+		for (uint64_t i = 0; i < step; i++) {
+			rank = rainbow_reduce(&keyspace, i, rainbow_hash(&keyspace, rank));
+		}
+		if (rainbow_hash(&keyspace, rank) != (uint32_t)hash) {
+			continue;
+		}
+		bool seen = false;
+		for (size_t i = 0; i < num_found && !seen; i++) {
+			seen = (found[i] == rank);
+		}
+		if (!seen) {
+			found = (uint64_t*)realloc(found, (num_found+1)*sizeof(uint64_t));
+			found[num_found++] = rank;
+			char string[KEYSPACE_MAX_LENGTH+1];
+			keyspace_global_string(map->header.charset, rank, string);
+			match(data, hash, string);
+		}
+	}
+	free(found);
+}
@@ -0,0 +1,226 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/serve.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <jhash/jhash.h>
+#include <jhash/table.h>
+#include <jhash/crack.h>
+
+/**
+ * The protocol is line oriented. A client sends one hexadecimal hash per
+ * line, and the server answers each with a "hash<TAB>string" line for every
+ * match in every table, followed by an empty line.
+ */
+
+typedef struct serve_state serve_state_t;
+
+struct serve_state {
+	int listen_fd;
+	table_map_t* tables;
+	int num_tables;
+};
+
+static const char* serve_socket_path = NULL;
+
+/**
+ * Removes the socket when the server is stopped
+ */
+static void serve_signal(int signal)
+{
+	unlink(serve_socket_path);
+	_exit(EXIT_SUCCESS);
+}
+
+/**
+ * Writes a match back to the client
+ */
+static void serve_match(void* data, jhash_t hash, const char* string)
+{
+	fprintf((FILE*)data, "%x\t%.16s\n", hash, string);
+}
+
+/**
+ * Answers requests from a client until it disconnects
+ */
+static void serve_client(serve_state_t* state, int client_fd)
+{
+	FILE* in = fdopen(client_fd, "r");
+	FILE* out = fdopen(dup(client_fd), "w");
+	if (!in || !out) {
+		if (in) {
+			fclose(in);
+		} else {
+			close(client_fd);
+		}
+		return;
+	}
+
+	char line[64];
+	while (fgets(line, sizeof(line), in) != NULL) {
+		char* end;
+		jhash_t hash = strtoul(line, &end, 16);
+		if (end != line) {
+			target_set_t targets;
+			target_set_init(&targets);
+			target_set_add(&targets, hash);
+			for (int i = 0; i < state->num_tables; i++) {
+				crack_lookup_all(&state->tables[i], &targets, serve_match, out);
+			}
+			target_set_free(&targets);
+		}
+		fputc('\n', out);
+		if (fflush(out) != 0) {
+			break;
+		}
+	}
+
+	fclose(out);
+	fclose(in);
+}
+
+/**
+ * Pool thread entry point, serves one client at a time
+ */
+static void* serve_thread(void* data)
+{
+	serve_state_t* state = (serve_state_t*)data;
+	while (true) {
+		int client_fd = accept(state->listen_fd, NULL, NULL);
+		if (client_fd >= 0) {
+			serve_client(state, client_fd);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Keeps tables resident and answers lookups on a unix domain socket
+ */
+void serve_tables(jhash_args_t* args)
+{
+	serve_state_t state;
+	state.num_tables = args->num_table_paths;
+	state.tables = (table_map_t*)calloc(state.num_tables, sizeof(table_map_t));
+	for (int i = 0; i < state.num_tables; i++) {
+		if (!table_map_open(&state.tables[i], args->table_paths[i])) {
+			char message[255];
+			sprintf(message, "%.200s: unable to open table for reading", args->table_paths[i]);
+			print_error(message, EXIT_FAILURE);
+		}
+
+		/* a table without an index would be scanned in full for every query */
+		int format = state.tables[i].header.format;
+		if (format != TABLE_FORMAT_SORTED && format != TABLE_FORMAT_COMPACT && format != TABLE_FORMAT_RAINBOW) {
+			char message[255];
+			sprintf(message, "%.180s: only sorted, compact and rainbow tables can be served", args->table_paths[i]);
+			print_error(message, EXIT_FAILURE);
+		}
+		table_map_advise(&state.tables[i], MADV_RANDOM);
+	}
+
+	/* listen on the socket */
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", args->socket_path);
+	unlink(addr.sun_path);
+	state.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (state.listen_fd < 0 || bind(state.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+			listen(state.listen_fd, SERVE_BACKLOG) != 0) {
+		char message[255];
+		sprintf(message, "%.200s: unable to listen on socket", args->socket_path);
+		print_error(message, EXIT_FAILURE);
+	}
+
+	serve_socket_path = args->socket_path;
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, serve_signal);
+	signal(SIGTERM, serve_signal);
+
+	if (args->verbose) {
+		fprintf(stderr, "serving %d tables on %s with %d threads\n", state.num_tables, args->socket_path, args->threads);
+	}
+
+	/* the calling thread is part of the pool */
+	for (int i = 1; i < args->threads; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, serve_thread, &state) != 0) {
+			print_error("unable to start server thread", EXIT_FAILURE);
+		}
+		pthread_detach(thread);
+	}
+	serve_thread(&state);
+}
+
+/**
+ * Sends the target hashes to a server and outputs its answers
+ */
+void query_server(jhash_args_t* args)
+{
+	target_set_t targets;
+	crack_load_targets(args, &targets);
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", args->socket_path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		char message[255];
+		sprintf(message, "%.200s: unable to connect to server", args->socket_path);
+		print_error(message, EXIT_FAILURE);
+	}
+	FILE* in = fdopen(fd, "r");
+	FILE* out = fdopen(dup(fd), "w");
+
+	for (size_t i = 0; i < targets.count; i++) {
+		jhash_t target = targets.targets[i];
+		fprintf(out, "%x\n", target);
+		fflush(out);
+
+		bool found = false;
+		char line[64];
+		while (fgets(line, sizeof(line), in) != NULL && line[0] != '\n') {
+			char* string = strchr(line, '\t');
+			if (string == NULL) {
+				continue;
+			}
+			string[strcspn(string, "\n")] = '\0';
+			found = true;
+			char hash_str[32];
+			format_hash(strtoul(line, NULL, 16), hash_str);
+			printf("%s\t%s\n", hash_str, string+1);
+		}
+		if (!found) {
+			fprintf(stderr, "unable to find result for %x\n", target);
+		}
+	}
+
+	fclose(out);
+	fclose(in);
+	target_set_free(&targets);
+}
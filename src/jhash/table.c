@@ -0,0 +1,749 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/table.h>
+#include <jhash/keyspace.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TABLE_RADIX_BITS 11 /* keeps a pass's 2048 write positions cache resident */
+#define TABLE_RADIX_PASSES ((32 + TABLE_RADIX_BITS - 1)/TABLE_RADIX_BITS)
+#define TABLE_MERGE_MIN_BUFFER 4096 /* entries, the smallest buffer a run is merged through */
+
+typedef struct table_run table_run_t;
+
+/**
+ * A sorted run being merged, read through its own buffer
+ */
+struct table_run {
+	int fd;
+	uint64_t offset; /* of the next entry to read */
+	uint64_t remaining; /* entries not yet read into the buffer */
+	table_entry_t* buffer;
+	uint64_t capacity;
+	uint64_t position;
+	uint64_t count;
+};
+
+/**
+ * The size of an entry in a table with a header
+ */
+static uint64_t table_entry_size(table_header_t* header)
+{
+	switch (header->format) {
+	case TABLE_FORMAT_COMPACT:
+		return sizeof(table_record_t);
+	case TABLE_FORMAT_HASHES:
+		return sizeof(uint32_t);
+	case TABLE_FORMAT_RAINBOW:
+		return sizeof(table_chain_t);
+	default:
+		return sizeof(table_entry_t);
+	}
+}
+
+/**
+ * Maps a table into memory and locates its directory and entries
+ */
+bool table_map_open(table_map_t* map, const char* path)
+{
+	memset(map, 0, sizeof(table_map_t));
+	map->fd = open(path, O_RDONLY);
+	if (map->fd < 0) {
+		return false;
+	}
+
+	struct stat table_stat;
+	if (fstat(map->fd, &table_stat) != 0) {
+		close(map->fd);
+		return false;
+	}
+	map->size = table_stat.st_size;
+	if (map->size > 0) {
+		map->data = (uint8_t*)mmap(NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0);
+		if (map->data == MAP_FAILED) {
+			close(map->fd);
+			return false;
+		}
+	}
+
+	/* headerless tables are just a stream of entries */
+	if (map->size >= sizeof(table_header_t)) {
+		memcpy(&map->header, map->data, sizeof(table_header_t));
+	}
+	if (map->header.magic != TABLE_MAGIC) {
+		memset(&map->header, 0, sizeof(table_header_t));
+		map->header.format = TABLE_FORMAT_LEGACY;
+		map->entries = (const table_entry_t*)map->data;
+		map->num_entries = map->size/sizeof(table_entry_t);
+		return true;
+	}
+
+	/* check the header is sane and the directory and entries are all there,
+	 * without trusting num_entries not to overflow the table's size */
+	table_header_t* header = &map->header;
+	header->charset[sizeof(header->charset)-1] = '\0';
+	if (header->bucket_bits > TABLE_MAX_BUCKET_BITS || header->format > TABLE_FORMAT_RAINBOW ||
+			header->max_len < 1 || header->max_len > KEYSPACE_MAX_LENGTH ||
+			table_entry_offset(header, 0) > map->size ||
+			header->num_entries > (map->size - table_entry_offset(header, 0))/table_entry_size(header)) {
+		table_map_close(map);
+		return false;
+	}
+	map->num_entries = header->num_entries;
+	switch (header->format) {
+	case TABLE_FORMAT_SORTED:
+		map->directory = (const uint64_t*)(map->data + table_directory_offset(0));
+		map->entries = (const table_entry_t*)(map->data + table_entry_offset(header, 0));
+		break;
+	case TABLE_FORMAT_COMPACT:
+		map->directory = (const uint64_t*)(map->data + table_directory_offset(0));
+		map->records = (const table_record_t*)(map->data + table_entry_offset(header, 0));
+		break;
+	case TABLE_FORMAT_HASHES:
+		map->hashes = (const uint32_t*)(map->data + table_entry_offset(header, 0));
+		break;
+	case TABLE_FORMAT_RAINBOW:
+		map->chain_len = *(const uint64_t*)(map->data + sizeof(table_header_t));
+		map->chains = (const table_chain_t*)(map->data + table_entry_offset(header, 0));
+		break;
+	}
+	return true;
+}
+
+/**
+ * Passes an madvise hint for the whole table
+ */
+void table_map_advise(table_map_t* map, int advice)
+{
+	if (map->size > 0) {
+		madvise(map->data, map->size, advice);
+	}
+}
+
+/**
+ * Unmaps a table
+ */
+void table_map_close(table_map_t* map)
+{
+	if (map->size > 0) {
+		munmap(map->data, map->size);
+	}
+	close(map->fd);
+	memset(map, 0, sizeof(table_map_t));
+}
+
+/**
+ * The file offset of a bucket's directory slot
+ */
+uint64_t table_directory_offset(uint32_t bucket)
+{
+	return sizeof(table_header_t) + (uint64_t)bucket*sizeof(uint64_t);
+}
+
+/**
+ * Fills in a header for a new table
+ */
+void table_header_init(table_header_t* header, int format, uint64_t num_entries, const char* charset, int max_len)
+{
+	memset(header, 0, sizeof(table_header_t));
+	header->magic = TABLE_MAGIC;
+	header->version = TABLE_VERSION;
+	header->format = format;
+	if (format != TABLE_FORMAT_HASHES && format != TABLE_FORMAT_RAINBOW) {
+		header->bucket_bits = table_choose_bucket_bits(num_entries);
+	}
+	header->num_entries = num_entries;
+	header->min_len = 1;
+	header->max_len = max_len;
+	snprintf(header->charset, sizeof(header->charset), "%s", charset);
+}
+
+/**
+ * The file offset of an entry in a table with a header
+ */
+uint64_t table_entry_offset(table_header_t* header, uint64_t entry)
+{
+	switch (header->format) {
+	case TABLE_FORMAT_HASHES:
+		return sizeof(table_header_t) + entry*table_entry_size(header);
+	case TABLE_FORMAT_RAINBOW:
+		return sizeof(table_header_t) + sizeof(uint64_t) + entry*table_entry_size(header);
+	default:
+		return table_directory_offset((1ULL << header->bucket_bits)+1) + entry*table_entry_size(header);
+	}
+}
+
+/**
+ * The number of low bits of a compact record which hold the rank
+ */
+uint32_t table_record_rank_bits(uint32_t bucket_bits)
+{
+	return 32 + bucket_bits;
+}
+
+/**
+ * The bucket a hash belongs in, keyed on its top bits
+ */
+uint32_t table_bucket(jhash_t hash, uint32_t bucket_bits)
+{
+	if (bucket_bits == 0) {
+		return 0;
+	}
+	return (uint32_t)hash >> (32 - bucket_bits);
+}
+
+/**
+ * Picks a directory size which keeps buckets around TABLE_BUCKET_TARGET entries
+ */
+uint32_t table_choose_bucket_bits(uint64_t num_entries)
+{
+	uint32_t bits = 0;
+	while (bits < TABLE_MAX_BUCKET_BITS && (num_entries >> bits) > TABLE_BUCKET_TARGET) {
+		bits++;
+	}
+	return bits;
+}
+
+/**
+ * Sorts entries by hash with an LSD radix sort, TABLE_RADIX_BITS a pass.
+ * The sort is stable, so entries with the same hash keep the order they
+ * were generated in. Returns whichever of the two buffers holds the result.
+ */
+static table_entry_t* table_radix_sort(table_entry_t* entries, table_entry_t* scratch, uint64_t count)
+{
+	const uint32_t radix_mask = (1 << TABLE_RADIX_BITS) - 1;
+	uint64_t offsets[TABLE_RADIX_PASSES][1 << TABLE_RADIX_BITS];
+	memset(offsets, 0, sizeof(offsets));
+
+	/* one read builds the histograms for every pass */
+	for (uint64_t i = 0; i < count; i++) {
+		uint32_t hash = (uint32_t)entries[i].hash;
+		for (int pass = 0; pass < TABLE_RADIX_PASSES; pass++) {
+			offsets[pass][(hash >> (pass*TABLE_RADIX_BITS)) & radix_mask]++;
+		}
+	}
+
+	for (int pass = 0; pass < TABLE_RADIX_PASSES; pass++) {
+		uint64_t offset = 0;
+		for (uint32_t digit = 0; digit <= radix_mask; digit++) {
+			uint64_t digit_count = offsets[pass][digit];
+			offsets[pass][digit] = offset;
+			offset += digit_count;
+		}
+
+		int shift = pass*TABLE_RADIX_BITS;
+		for (uint64_t i = 0; i < count; i++) {
+			uint32_t digit = ((uint32_t)entries[i].hash >> shift) & radix_mask;
+			scratch[offsets[pass][digit]++] = entries[i];
+		}
+		table_entry_t* sorted = scratch;
+		scratch = entries;
+		entries = sorted;
+	}
+
+	return entries;
+}
+
+/**
+ * Writes sorted entries to a table, counting them into their buckets. A
+ * compact table's entries carry their rank in place of a string, and are
+ * packed into records as they're written. Without a header the entries are
+ * a scratch run, and are written as they are.
+ */
+static bool table_write_sorted(FILE* out, table_header_t* header, uint64_t* bucket_counts, table_entry_t* entries, uint64_t count)
+{
+	if (header == NULL) {
+		return fwrite(entries, sizeof(table_entry_t), count, out) == count;
+	}
+	uint32_t bucket_bits = header->bucket_bits;
+	for (uint64_t i = 0; i < count; i++) {
+		bucket_counts[table_bucket(entries[i].hash, bucket_bits)+1]++;
+	}
+	if (header->format != TABLE_FORMAT_COMPACT) {
+		return fwrite(entries, sizeof(table_entry_t), count, out) == count;
+	}
+
+	/* records are smaller than entries, so they're packed in place */
+	uint32_t rank_bits = table_record_rank_bits(bucket_bits);
+	uint64_t hash_mask = (bucket_bits == 0) ? 0xffffffffULL : (1ULL << (32 - bucket_bits)) - 1;
+	table_record_t* records = (table_record_t*)entries;
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t rank;
+		memcpy(&rank, entries[i].string, sizeof(rank));
+		table_record_t record = (((uint32_t)entries[i].hash & hash_mask) << rank_bits) | rank;
+		memcpy(&records[i], &record, sizeof(table_record_t));
+	}
+	return fwrite(records, sizeof(table_record_t), count, out) == count;
+}
+
+/**
+ * Refills a run's buffer from its file, returning false on a read error
+ */
+static bool table_run_fill(table_run_t* run)
+{
+	uint64_t count = (run->remaining < run->capacity) ? run->remaining : run->capacity;
+	size_t size = count*sizeof(table_entry_t);
+	if (pread(run->fd, run->buffer, size, run->offset) != (ssize_t)size) {
+		return false;
+	}
+	run->offset += size;
+	run->remaining -= count;
+	run->position = 0;
+	run->count = count;
+	return true;
+}
+
+/**
+ * Whether run a's next entry sorts before run b's. Ties go to the earlier
+ * run, which keeps the merge stable.
+ */
+static bool table_run_before(table_run_t* runs, int a, int b)
+{
+	uint32_t hash_a = (uint32_t)runs[a].buffer[runs[a].position].hash;
+	uint32_t hash_b = (uint32_t)runs[b].buffer[runs[b].position].hash;
+	return hash_a < hash_b || (hash_a == hash_b && a < b);
+}
+
+/**
+ * Restores the min heap property of the run heap below a node
+ */
+static void table_run_sift_down(table_run_t* runs, int* heap, int heap_size, int node)
+{
+	while (true) {
+		int smallest = node;
+		int left = 2*node + 1;
+		int right = left + 1;
+		if (left < heap_size && table_run_before(runs, heap[left], heap[smallest])) {
+			smallest = left;
+		}
+		if (right < heap_size && table_run_before(runs, heap[right], heap[smallest])) {
+			smallest = right;
+		}
+		if (smallest == node) {
+			return;
+		}
+		int swap = heap[node];
+		heap[node] = heap[smallest];
+		heap[smallest] = swap;
+		node = smallest;
+	}
+}
+
+/**
+ * Merges sorted runs into a table, with a min heap over the next entry of
+ * each run. The runs' files, offsets and lengths are filled in by the
+ * caller. The memory is split evenly between a read buffer for each run
+ * and the write buffer.
+ */
+static bool table_merge_runs(FILE* out, table_header_t* header, uint64_t* bucket_counts, table_run_t* runs, int num_runs,
+		table_entry_t* memory, uint64_t memory_entries)
+{
+	uint64_t buffer_entries = memory_entries/(num_runs+1);
+	int* heap = (int*)malloc(num_runs*sizeof(int));
+	bool success = (heap != NULL && buffer_entries > 0);
+
+	/* empty runs never join the heap */
+	int heap_size = 0;
+	for (int i = 0; success && i < num_runs; i++) {
+		runs[i].buffer = &memory[i*buffer_entries];
+		runs[i].capacity = buffer_entries;
+		success = table_run_fill(&runs[i]);
+		if (runs[i].count > 0) {
+			heap[heap_size++] = i;
+		}
+	}
+	for (int node = heap_size/2 - 1; success && node >= 0; node--) {
+		table_run_sift_down(runs, heap, heap_size, node);
+	}
+
+	table_entry_t* output = &memory[num_runs*buffer_entries];
+	uint64_t num_output = 0;
+	while (success && heap_size > 0) {
+		table_run_t* run = &runs[heap[0]];
+		output[num_output++] = run->buffer[run->position++];
+		if (num_output == buffer_entries) {
+			success = table_write_sorted(out, header, bucket_counts, output, num_output);
+			num_output = 0;
+		}
+
+		/* move on to the run's next entry, dropping the run once it's done */
+		if (run->position == run->count) {
+			if (run->remaining > 0) {
+				success &= table_run_fill(run);
+			} else {
+				heap[0] = heap[--heap_size];
+			}
+		}
+		table_run_sift_down(runs, heap, heap_size, 0);
+	}
+	if (success) {
+		success = table_write_sorted(out, header, bucket_counts, output, num_output);
+	}
+
+	free(heap);
+	return success;
+}
+
+/**
+ * Merges any number of sorted runs into a table. Memory only buffers so many
+ * runs at once, so while there are more than that, consecutive groups of them
+ * are merged into longer runs in a scratch file, alternating between two
+ * scratch files each pass. Merging consecutive groups keeps the merge stable.
+ */
+static bool table_merge_cascade(FILE* out, table_header_t* header, uint64_t* bucket_counts, table_run_t* runs, int num_runs,
+		table_entry_t* memory, uint64_t memory_entries, const char* out_path)
+{
+	int max_runs = (memory_entries/TABLE_MERGE_MIN_BUFFER > 3) ? memory_entries/TABLE_MERGE_MIN_BUFFER - 1 : 2;
+	if (num_runs <= max_runs) {
+		return table_merge_runs(out, header, bucket_counts, runs, num_runs, memory, memory_entries);
+	}
+
+	/* the merged runs replace the caller's, so work on a copy */
+	table_run_t* merging = (table_run_t*)malloc(num_runs*sizeof(table_run_t));
+	if (!merging) {
+		return false;
+	}
+	memcpy(merging, runs, num_runs*sizeof(table_run_t));
+
+	char scratch_paths[2][300];
+	FILE* scratch[2] = { NULL, NULL };
+	bool success = true;
+	for (int pass = 0; success && num_runs > max_runs; pass++) {
+		/* the file written two passes ago was read in full by the last pass */
+		int target = pass % 2;
+		if (scratch[target]) {
+			fclose(scratch[target]);
+		}
+		snprintf(scratch_paths[target], sizeof(scratch_paths[target]), "%s.merge%d", out_path, target);
+		scratch[target] = fopen(scratch_paths[target], "w+");
+		success = (scratch[target] != NULL);
+
+		int num_merged = 0;
+		for (int first = 0; success && first < num_runs; first += max_runs) {
+			int count = (num_runs - first < max_runs) ? num_runs - first : max_runs;
+			uint64_t offset = ftello(scratch[target]);
+			uint64_t length = 0;
+			for (int i = first; i < first + count; i++) {
+				length += merging[i].remaining;
+			}
+			success = table_merge_runs(scratch[target], NULL, NULL, &merging[first], count, memory, memory_entries) &&
+				fflush(scratch[target]) == 0;
+
+			/* every run this one replaces has already been merged */
+			merging[num_merged].fd = fileno(scratch[target]);
+			merging[num_merged].offset = offset;
+			merging[num_merged].remaining = length;
+			num_merged++;
+		}
+		num_runs = num_merged;
+	}
+	if (success) {
+		success = table_merge_runs(out, header, bucket_counts, merging, num_runs, memory, memory_entries);
+	}
+
+	for (int i = 0; i < 2; i++) {
+		if (scratch[i]) {
+			fclose(scratch[i]);
+			unlink(scratch_paths[i]);
+		}
+	}
+	free(merging);
+	return success;
+}
+
+/**
+ * Creates a sorted table, leaving a gap after the header for the directory
+ */
+static FILE* table_sorted_begin(const char* out_path, table_header_t* header)
+{
+	FILE* out = fopen(out_path, "w+");
+	if (out && (fwrite(header, sizeof(table_header_t), 1, out) != 1 ||
+			fseeko(out, table_entry_offset(header, 0), SEEK_SET) != 0)) {
+		fclose(out);
+		return NULL;
+	}
+	return out;
+}
+
+/**
+ * Turns the bucket counts into the directory, writes it into its gap and closes the table
+ */
+static bool table_sorted_finish(FILE* out, table_header_t* header, uint64_t* directory)
+{
+	uint64_t num_buckets = (1ULL << header->bucket_bits);
+	for (uint64_t bucket = 0; bucket < num_buckets; bucket++) {
+		directory[bucket+1] += directory[bucket];
+	}
+	bool success = fseeko(out, table_directory_offset(0), SEEK_SET) == 0 &&
+		fwrite(directory, sizeof(uint64_t), num_buckets+1, out) == num_buckets+1;
+	return (fclose(out) == 0) && success;
+}
+
+/**
+ * Reads count entries from a legacy table, or makes them from a hash only
+ * table's hashes from start on, each carrying its rank in place of a string
+ */
+static bool table_read_entries(FILE* in, const uint32_t* hashes, uint64_t start, table_entry_t* entries, uint64_t count)
+{
+	if (hashes == NULL) {
+		return fread(entries, sizeof(table_entry_t), count, in) == count;
+	}
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t rank = start + i;
+		entries[i].hash = hashes[rank];
+		memset(entries[i].string, 0, sizeof(entries[i].string));
+		memcpy(entries[i].string, &rank, sizeof(rank));
+	}
+	return true;
+}
+
+/**
+ * Sorts entries into the table the header describes. The entries are read
+ * in runs which fit in heap_mb, each run radix sorted, and if there's more
+ * than one they're spilled to a runs file and merged, over several passes if
+ * there are too many to merge at once. All of the reads and writes are
+ * sequential except for the directory, which is written last.
+ */
+static bool table_sort(FILE* in, const uint32_t* hashes, const char* out_path, table_header_t* header, unsigned int heap_mb)
+{
+	/* each run needs its entries and as many again to radix sort into */
+	uint64_t num_entries = header->num_entries;
+	uint64_t run_entries = ((uint64_t)heap_mb*1024*1024)/(2*sizeof(table_entry_t));
+	if (run_entries > num_entries) {
+		run_entries = num_entries;
+	}
+	if (run_entries == 0) {
+		run_entries = 1;
+	}
+	table_entry_t* entries = (table_entry_t*)malloc(2*run_entries*sizeof(table_entry_t));
+	uint64_t* directory = (uint64_t*)calloc((1ULL << header->bucket_bits)+1, sizeof(uint64_t));
+	FILE* out = table_sorted_begin(out_path, header);
+	bool success = (entries != NULL && directory != NULL && out != NULL);
+
+	if (success && num_entries <= run_entries) {
+		success = table_read_entries(in, hashes, 0, entries, num_entries);
+		if (success) {
+			table_entry_t* sorted = table_radix_sort(entries, &entries[run_entries], num_entries);
+			success = table_write_sorted(out, header, directory, sorted, num_entries);
+		}
+	} else if (success) {
+		char runs_path[300];
+		snprintf(runs_path, sizeof(runs_path), "%s.runs", out_path);
+		FILE* runs_fd = fopen(runs_path, "w+");
+		int num_runs = (num_entries + run_entries - 1)/run_entries;
+		table_run_t* runs = (table_run_t*)calloc(num_runs, sizeof(table_run_t));
+		success = (runs_fd != NULL && runs != NULL);
+		for (int i = 0; success && i < num_runs; i++) {
+			uint64_t start = (uint64_t)i*run_entries;
+			uint64_t count = (num_entries - start < run_entries) ? num_entries - start : run_entries;
+			success = table_read_entries(in, hashes, start, entries, count);
+			if (success) {
+				table_entry_t* sorted = table_radix_sort(entries, &entries[run_entries], count);
+				success = fwrite(sorted, sizeof(table_entry_t), count, runs_fd) == count;
+			}
+			runs[i].fd = fileno(runs_fd);
+			runs[i].offset = start*sizeof(table_entry_t);
+			runs[i].remaining = count;
+		}
+		if (success) {
+			success = fflush(runs_fd) == 0 &&
+				table_merge_cascade(out, header, directory, runs, num_runs, entries, 2*run_entries, out_path);
+		}
+		if (runs_fd) {
+			fclose(runs_fd);
+			unlink(runs_path);
+		}
+		free(runs);
+	}
+
+	if (out) {
+		success = table_sorted_finish(out, header, directory) && success;
+	}
+	free(directory);
+	free(entries);
+	return success;
+}
+
+/**
+ * Sorts a legacy table into a sorted, indexed table, within heap_mb
+ */
+bool table_sort_file(const char* in_path, const char* out_path, const char* charset, int max_len, unsigned int heap_mb)
+{
+	FILE* in = fopen(in_path, "r");
+	if (!in) {
+		return false;
+	}
+	fseeko(in, 0, SEEK_END);
+	uint64_t num_entries = ftello(in)/sizeof(table_entry_t);
+	fseeko(in, 0, SEEK_SET);
+
+	table_header_t header;
+	table_header_init(&header, TABLE_FORMAT_SORTED, num_entries, charset, max_len);
+	bool success = table_sort(in, NULL, out_path, &header, heap_mb);
+	fclose(in);
+	return success;
+}
+
+/**
+ * Merges sorted tables of the same charset into one sorted table, within
+ * heap_mb of buffers. The result covers the longest of their lengths.
+ */
+bool table_merge_sorted(char** in_paths, int num_inputs, const char* out_path, unsigned int heap_mb)
+{
+	table_run_t* runs = (table_run_t*)calloc(num_inputs, sizeof(table_run_t));
+	if (!runs) {
+		return false;
+	}
+	for (int i = 0; i < num_inputs; i++) {
+		runs[i].fd = -1;
+	}
+
+	/* check the inputs match and locate their entries */
+	table_header_t first;
+	memset(&first, 0, sizeof(table_header_t));
+	uint64_t num_entries = 0;
+	bool success = true;
+	for (int i = 0; success && i < num_inputs; i++) {
+		table_map_t map;
+		if (!table_map_open(&map, in_paths[i])) {
+			success = false;
+			break;
+		}
+		if (i == 0) {
+			first = map.header;
+		}
+		success = map.header.format == TABLE_FORMAT_SORTED && strcmp(map.header.charset, first.charset) == 0;
+		if (map.header.max_len > first.max_len) {
+			first.max_len = map.header.max_len;
+		}
+		runs[i].offset = table_entry_offset(&map.header, 0);
+		runs[i].remaining = map.num_entries;
+		num_entries += map.num_entries;
+		table_map_close(&map);
+		runs[i].fd = open(in_paths[i], O_RDONLY);
+		success &= (runs[i].fd >= 0);
+	}
+
+	uint64_t memory_entries = ((uint64_t)heap_mb*1024*1024)/sizeof(table_entry_t);
+	table_entry_t* memory = NULL;
+	uint64_t* directory = NULL;
+	if (success) {
+		table_header_t header;
+		table_header_init(&header, TABLE_FORMAT_SORTED, num_entries, first.charset, first.max_len);
+		memory = (table_entry_t*)malloc(memory_entries*sizeof(table_entry_t));
+		directory = (uint64_t*)calloc((1ULL << header.bucket_bits)+1, sizeof(uint64_t));
+		FILE* out = table_sorted_begin(out_path, &header);
+		success = (memory != NULL && directory != NULL && out != NULL) &&
+			table_merge_cascade(out, &header, directory, runs, num_inputs, memory, memory_entries, out_path);
+		if (out) {
+			success = table_sorted_finish(out, &header, directory) && success;
+		}
+	}
+
+	for (int i = 0; i < num_inputs; i++) {
+		if (runs[i].fd >= 0) {
+			close(runs[i].fd);
+		}
+	}
+	free(directory);
+	free(memory);
+	free(runs);
+	return success;
+}
+
+/**
+ * Sorts a hash only table into a compact table, within heap_mb. Each hash is
+ * sorted along with its rank, and as runs are stably sorted and stably merged
+ * the records come out in (hash, rank) order.
+ */
+bool table_sort_compact(const char* in_path, const char* out_path, unsigned int heap_mb)
+{
+	table_map_t map;
+	if (!table_map_open(&map, in_path) || map.header.format != TABLE_FORMAT_HASHES) {
+		return false;
+	}
+	table_map_advise(&map, MADV_SEQUENTIAL);
+
+	table_header_t header;
+	table_header_init(&header, TABLE_FORMAT_COMPACT, map.num_entries, map.header.charset, map.header.max_len);
+	bool success = table_sort(NULL, map.hashes, out_path, &header, heap_mb);
+	table_map_close(&map);
+	return success;
+}
+
+/**
+ * Unpacks a compact table back into the hash only table it was sorted
+ * from. Each record holds its rank, and the bucket holds the top bits of
+ * its hash. The hashes are put back in order a window of ranks at a time,
+ * as many as fit in heap_mb, each window taking a pass over the records.
+ */
+bool table_unpack_compact(const char* in_path, const char* out_path, unsigned int heap_mb)
+{
+	table_map_t map;
+	if (!table_map_open(&map, in_path) || map.header.format != TABLE_FORMAT_COMPACT) {
+		return false;
+	}
+	table_map_advise(&map, MADV_SEQUENTIAL);
+
+	uint32_t bucket_bits = map.header.bucket_bits;
+	uint32_t rank_bits = table_record_rank_bits(bucket_bits);
+	uint64_t rank_mask = (1ULL << rank_bits) - 1;
+	uint64_t window = ((uint64_t)heap_mb*1024*1024)/sizeof(uint32_t);
+	if (window > map.num_entries) {
+		window = map.num_entries;
+	}
+	if (window == 0) {
+		window = 1;
+	}
+	uint32_t* hashes = (uint32_t*)malloc(window*sizeof(uint32_t));
+
+	table_header_t header;
+	table_header_init(&header, TABLE_FORMAT_HASHES, map.num_entries, map.header.charset, map.header.max_len);
+	FILE* out = hashes ? fopen(out_path, "w") : NULL;
+	bool success = (out != NULL) && fwrite(&header, sizeof(table_header_t), 1, out) == 1;
+	for (uint64_t first = 0; success && first < map.num_entries; first += window) {
+		uint64_t count = (map.num_entries - first < window) ? map.num_entries - first : window;
+		for (uint64_t bucket = 0; bucket < (1ULL << bucket_bits); bucket++) {
+			uint32_t top = (bucket_bits == 0) ? 0 : (uint32_t)(bucket << (32 - bucket_bits));
+			for (uint64_t i = map.directory[bucket]; i < map.directory[bucket+1]; i++) {
+				uint64_t rank = map.records[i] & rank_mask;
+				success &= (rank < map.num_entries);
+				if (rank >= first && rank - first < count) {
+					hashes[rank - first] = top | (uint32_t)(map.records[i] >> rank_bits);
+				}
+			}
+		}
+		success = success && fwrite(hashes, sizeof(uint32_t), count, out) == count;
+	}
+	if (out) {
+		success = (fclose(out) == 0) && success;
+		if (!success) {
+			unlink(out_path);
+		}
+	}
+
+	table_map_close(&map);
+	free(hashes);
+	return success;
+}
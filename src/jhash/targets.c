@@ -0,0 +1,201 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/targets.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <jhash/args.h>
+
+#define TARGET_MIN_BITS 4
+#define TARGET_BLOOM_MAX_BLOCK_BITS 32
+
+/**
+ * Allocates a table of 1 << bits slots, plus one for the zero target
+ */
+static void target_set_alloc(target_set_t* set, uint32_t bits)
+{
+	set->mask = (1U << bits) - 1;
+	set->shift = 32 - bits;
+	set->slots = (uint32_t*)calloc((size_t)set->mask+2, sizeof(uint32_t));
+	set->found = (bool*)calloc((size_t)set->mask+2, sizeof(bool));
+	if (!set->slots || !set->found) {
+		print_error("unable to allocate target set", EXIT_FAILURE);
+	}
+}
+
+/**
+ * Initializes an empty target set
+ */
+void target_set_init(target_set_t* set)
+{
+	memset(set, 0, sizeof(target_set_t));
+	target_set_alloc(set, TARGET_MIN_BITS);
+}
+
+/**
+ * Frees a target set's storage
+ */
+void target_set_free(target_set_t* set)
+{
+	free(set->slots);
+	free(set->found);
+	free(set->targets);
+	free(set->bloom);
+}
+
+/**
+ * Sets a hash's bits in the filter
+ */
+static void target_set_filter_insert(target_set_t* set, jhash_t hash)
+{
+	uint64_t key = (uint32_t)hash;
+	uint64_t* block = &set->bloom[(((key*0x9e3779b97f4a7c15ULL) >> 32) & set->bloom_mask)*TARGET_BLOOM_BLOCK_WORDS];
+	uint64_t bits = key*0xc2b2ae3d27d4eb4fULL;
+	for (int i = 0; i < set->bloom_hashes; i++, bits <<= 9) {
+		uint32_t bit = bits >> 55;
+		block[bit >> 6] |= (1ULL << (bit & 63));
+	}
+}
+
+/**
+ * Inserts a hash into the slot table, which must have room
+ */
+static void target_set_insert(target_set_t* set, uint32_t key)
+{
+	if (key == 0) {
+		set->has_zero = true;
+		return;
+	}
+	uint32_t slot = (key*0x9e3779b1) >> set->shift;
+	while (set->slots[slot] != 0) {
+		slot = (slot + 1) & set->mask;
+	}
+	set->slots[slot] = key;
+}
+
+/**
+ * Adds a target, returning false if it was already present
+ */
+bool target_set_add(target_set_t* set, jhash_t hash)
+{
+	if (target_set_find(set, hash) != TARGET_NONE) {
+		return false;
+	}
+
+	/* keep the load factor under a half */
+	if ((set->count+1)*2 > (size_t)set->mask+1) {
+		uint32_t* old_slots = set->slots;
+		uint32_t old_size = set->mask+1;
+		free(set->found);
+		target_set_alloc(set, 33 - set->shift);
+		for (uint32_t i = 0; i < old_size; i++) {
+			if (old_slots[i] != 0) {
+				target_set_insert(set, old_slots[i]);
+			}
+		}
+		free(old_slots);
+	}
+	target_set_insert(set, (uint32_t)hash);
+
+	if (set->count == set->capacity) {
+		set->capacity = set->capacity ? set->capacity*2 : 16;
+		set->targets = (jhash_t*)realloc(set->targets, set->capacity*sizeof(jhash_t));
+	}
+	set->targets[set->count++] = hash;
+	if (set->bloom != NULL) {
+		target_set_filter_insert(set, hash);
+	}
+	return true;
+}
+
+/**
+ * Builds a bloom filter of the targets, sized for a false positive rate
+ * and/or limited to max_bytes, whichever is smaller. Either may be zero
+ * to leave it unconstrained, but not both. The number of blocks is rounded
+ * to a power of two, and the number of bits set per target chosen to suit.
+ */
+void target_set_build_filter(target_set_t* set, double fp_rate, size_t max_bytes)
+{
+	double num_targets = set->count ? set->count : 1;
+	double wanted_bits = (fp_rate > 0) ? -num_targets*log(fp_rate)/(M_LN2*M_LN2) : (double)max_bytes*8;
+	if (max_bytes > 0 && wanted_bits > (double)max_bytes*8) {
+		wanted_bits = (double)max_bytes*8;
+	}
+	uint32_t block_bits = 0;
+	while (block_bits < TARGET_BLOOM_MAX_BLOCK_BITS && (double)((uint64_t)TARGET_BLOOM_BLOCK_BITS << block_bits) < wanted_bits) {
+		block_bits++;
+	}
+	if (block_bits > 0 && max_bytes > 0 && ((uint64_t)TARGET_BLOOM_BLOCK_BITS << block_bits)/8 > max_bytes) {
+		block_bits--;
+	}
+
+	uint64_t num_blocks = 1ULL << block_bits;
+	int num_hashes = (int)(num_blocks*TARGET_BLOOM_BLOCK_BITS/num_targets*M_LN2 + 0.5);
+	free(set->bloom);
+	set->bloom = NULL;
+	if (posix_memalign((void**)&set->bloom, 64, num_blocks*TARGET_BLOOM_BLOCK_WORDS*sizeof(uint64_t)) != 0) {
+		print_error("unable to allocate bloom filter", EXIT_FAILURE);
+	}
+	memset(set->bloom, 0, num_blocks*TARGET_BLOOM_BLOCK_WORDS*sizeof(uint64_t));
+	set->bloom_mask = num_blocks - 1;
+	set->bloom_hashes = (num_hashes < 1) ? 1 : (num_hashes > TARGET_BLOOM_MAX_HASHES) ? TARGET_BLOOM_MAX_HASHES : num_hashes;
+	for (size_t i = 0; i < set->count; i++) {
+		target_set_filter_insert(set, set->targets[i]);
+	}
+}
+
+/**
+ * The expected false positive rate of the filter, from how full it is
+ */
+double target_set_filter_rate(target_set_t* set)
+{
+	uint64_t num_words = (set->bloom_mask+1)*TARGET_BLOOM_BLOCK_WORDS;
+	uint64_t num_set = 0;
+	for (uint64_t i = 0; i < num_words; i++) {
+		num_set += __builtin_popcountll(set->bloom[i]);
+	}
+	return pow((double)num_set/(num_words*64), set->bloom_hashes);
+}
+
+/**
+ * Reads newline separated hashes from a file. Blank lines are skipped.
+ */
+bool target_set_load(target_set_t* set, FILE* fd, int ident_mode)
+{
+	char line[64];
+	while (fgets(line, sizeof(line), fd) != NULL) {
+		char* start = line;
+		while (isspace((unsigned char)*start)) {
+			start++;
+		}
+		if (*start == '\0') {
+			continue;
+		}
+
+		char* end;
+		unsigned long hash = strtoul(start, &end, ident_mode == HASH_DECIMAL ? 10 : 16);
+		if (end == start || (*end != '\0' && !isspace((unsigned char)*end))) {
+			return false;
+		}
+		target_set_add(set, (jhash_t)hash);
+	}
+	return !ferror(fd);
+}
+
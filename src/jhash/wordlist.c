@@ -0,0 +1,399 @@
+/**
+ *  This file is part of Gem.
+ *
+ *  Gem is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Gem is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Gem.  If not, see <http://www.gnu.org/licenses/\>.
+ */
+
+#include <jhash/wordlist.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <jhash/jhash.h>
+#include <jhash/mask.h>
+#include <jhash/batch.h>
+#include <jhash/crack.h>
+#include <jhash/targets.h>
+
+/**
+ * Candidates are built from a wordlist by rules. A rule is a template in
+ * which ?w is the word being read and ?v is any word of the wordlist, and
+ * everything else is a mask, eg.
+ *   ?w        the word as is
+ *   ?w_?v     two words joined with an underscore
+ *   ?w?d?d    the word with two digits appended
+ *   ?w.dat    the word with an extension
+ * The wordlist is streamed by the workers a block at a time, so it's only
+ * held in memory when a rule uses ?v. jagex_hash folds everything to upper
+ * case, so there's no need for rules that vary the case of a word.
+ */
+
+#define RULE_WORD 0 /* ?w */
+#define RULE_PAIR_WORD 1 /* ?v */
+#define RULE_CHARS 2 /* one position of a mask */
+
+typedef char wordlist_word_t[BATCH_STRING_LEN+1];
+typedef struct rule_segment rule_segment_t;
+typedef struct rule rule_t;
+typedef struct wordlist_state wordlist_state_t;
+
+/**
+ * Masks are split into a segment per position, so that stepping to the next
+ * candidate is a counter increment rather than an unrank
+ */
+struct rule_segment {
+	int type; /* one of RULE_{WORD,PAIR_WORD,CHARS} */
+	uint64_t size; /* the number of strings the segment can take */
+	char chars[MASK_MAX_CHARSET+1];
+};
+
+struct rule {
+	rule_segment_t segments[KEYSPACE_MAX_LENGTH];
+	int num_segments;
+};
+
+struct wordlist_state {
+	FILE* fd;
+	rule_t* rules;
+	int num_rules;
+	wordlist_word_t* pair_words;
+	uint64_t num_pair_words;
+	target_set_t* targets;
+	uint64_t candidates;
+	pthread_mutex_t read_lock;
+	pthread_mutex_t report_lock;
+};
+
+/**
+ * Appends a segment to a rule, returning NULL if the rule is full. Every
+ * segment adds at least one character, so a longer rule couldn't be hashed.
+ */
+static rule_segment_t* rule_add_segment(rule_t* rule, int type)
+{
+	if (rule->num_segments == KEYSPACE_MAX_LENGTH) {
+		return NULL;
+	}
+	rule_segment_t* segment = &rule->segments[rule->num_segments++];
+	segment->type = type;
+	segment->size = 1;
+	return segment;
+}
+
+/**
+ * Appends the mask between two words to a rule, returning false if it's invalid
+ */
+static bool rule_add_mask(rule_t* rule, const char* spec, jhash_args_t* args)
+{
+	if (spec[0] == '\0') {
+		return true;
+	}
+	mask_t mask;
+	if (!mask_parse(&mask, spec, args->custom_charsets, args->charset)) {
+		return false;
+	}
+	for (int i = 0; i < mask.length; i++) {
+		rule_segment_t* segment = rule_add_segment(rule, RULE_CHARS);
+		if (segment == NULL) {
+			return false;
+		}
+		strcpy(segment->chars, mask.positions[i]);
+		segment->size = strlen(segment->chars);
+	}
+	return true;
+}
+
+/**
+ * Parses a rule template, returning false if it's invalid or never uses the word
+ */
+static bool rule_parse(rule_t* rule, const char* spec, jhash_args_t* args)
+{
+	memset(rule, 0, sizeof(rule_t));
+	char fragment[WORDLIST_MAX_RULE_LEN+1] = "";
+	size_t fragment_len = 0;
+	bool has_word = false;
+	for (; *spec != '\0'; spec++) {
+		if (spec[0] == '?' && (spec[1] == 'w' || spec[1] == 'v')) {
+			fragment[fragment_len] = '\0';
+			fragment_len = 0;
+			int type = (*++spec == 'w') ? RULE_WORD : RULE_PAIR_WORD;
+			if (!rule_add_mask(rule, fragment, args) || rule_add_segment(rule, type) == NULL) {
+				return false;
+			}
+			has_word |= (type == RULE_WORD);
+			continue;
+		}
+
+		/* keep escapes such as ?? together, so the mask sees them whole */
+		size_t len = (spec[0] == '?' && spec[1] != '\0') ? 2 : 1;
+		if (fragment_len + len > WORDLIST_MAX_RULE_LEN) {
+			return false;
+		}
+		memcpy(&fragment[fragment_len], spec, len);
+		fragment_len += len;
+		spec += len - 1;
+	}
+	fragment[fragment_len] = '\0';
+	return rule_add_mask(rule, fragment, args) && has_word;
+}
+
+/**
+ * Reads the next word, returning false at the end of the wordlist. Empty
+ * lines and words too long to hash are skipped.
+ */
+static bool wordlist_read_word(FILE* fd, wordlist_word_t word)
+{
+	char line[256];
+	while (fgets(line, sizeof(line), fd) != NULL) {
+		size_t len = strcspn(line, "\r\n");
+		bool truncated = (line[len] == '\0' && len == sizeof(line)-1);
+		if (truncated) { /* discard the rest of an overlong line */
+			int c;
+			while ((c = fgetc(fd)) != EOF && c != '\n');
+		}
+		if (len == 0 || len > BATCH_STRING_LEN || truncated) {
+			continue;
+		}
+		memcpy(word, line, len);
+		word[len] = '\0';
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Reads a block of up to WORDLIST_BLOCK_SIZE words for a worker, returning how many
+ */
+static int wordlist_read_block(wordlist_state_t* state, wordlist_word_t* words)
+{
+	pthread_mutex_lock(&state->read_lock);
+	int count = 0;
+	while (count < WORDLIST_BLOCK_SIZE && wordlist_read_word(state->fd, words[count])) {
+		count++;
+	}
+	pthread_mutex_unlock(&state->read_lock);
+	return count;
+}
+
+/**
+ * Hashes a batch of candidates, outputting those which are targets
+ */
+static void wordlist_flush(wordlist_state_t* state, batch_string_t* batch, jhash_t* hashes, size_t count)
+{
+	jagex_hash_batch(batch, count, hashes);
+	for (size_t i = 0; i < count; i++) {
+		if (!target_set_contains(state->targets, hashes[i])) {
+			continue;
+		}
+		pthread_mutex_lock(&state->report_lock);
+		state->targets->found[target_set_find(state->targets, hashes[i])] = true;
+		char hash_str[32];
+		format_hash(hashes[i], hash_str);
+		printf("%s\t%.16s\n", hash_str, batch[i]);
+		pthread_mutex_unlock(&state->report_lock);
+	}
+	__atomic_fetch_add(&state->candidates, count, __ATOMIC_RELAXED);
+}
+
+/**
+ * Worker thread entry point, expands blocks of words by every rule
+ */
+static void* wordlist_worker_run(void* data)
+{
+	wordlist_state_t* state = (wordlist_state_t*)data;
+	wordlist_word_t* words = (wordlist_word_t*)malloc(WORDLIST_BLOCK_SIZE*sizeof(wordlist_word_t));
+	batch_string_t* batch = (batch_string_t*)malloc(WORDLIST_BATCH_SIZE*sizeof(batch_string_t));
+	jhash_t* hashes = (jhash_t*)malloc(WORDLIST_BATCH_SIZE*sizeof(jhash_t));
+	if (!words || !batch || !hashes) {
+		print_error("unable to allocate wordlist buffers", EXIT_FAILURE);
+	}
+
+	size_t batched = 0;
+	int num_words;
+	while ((num_words = wordlist_read_block(state, words)) > 0) {
+		for (int w = 0; w < num_words; w++) {
+			for (int r = 0; r < state->num_rules; r++) {
+				rule_t* rule = &state->rules[r];
+
+				/* count through every combination of the rule's segments. Only
+				 * a change of pair word moves the segments after it, so
+				 * otherwise just the characters which changed are rewritten */
+				uint64_t digits[KEYSPACE_MAX_LENGTH] = { 0 };
+				size_t offsets[KEYSPACE_MAX_LENGTH];
+				char candidate[2*BATCH_STRING_LEN+1];
+				size_t len = 0;
+				bool rebuild = true;
+				int changed = 0;
+				bool done = (rule->num_segments == 0);
+				while (!done) {
+					if (rebuild) {
+						len = 0;
+						for (int i = 0; i < rule->num_segments && len <= BATCH_STRING_LEN; i++) {
+							rule_segment_t* segment = &rule->segments[i];
+							offsets[i] = len;
+							if (segment->type == RULE_CHARS) {
+								candidate[len++] = segment->chars[digits[i]];
+								continue;
+							}
+							const char* word = (segment->type == RULE_WORD) ? words[w] : state->pair_words[digits[i]];
+							size_t word_len = strlen(word);
+							memcpy(&candidate[len], word, word_len);
+							len += word_len;
+						}
+						if (len <= BATCH_STRING_LEN) {
+							memset(&candidate[len], 0, BATCH_STRING_LEN - len);
+						}
+					} else {
+						for (int i = 0; i <= changed; i++) {
+							if (rule->segments[i].type == RULE_CHARS) {
+								candidate[offsets[i]] = rule->segments[i].chars[digits[i]];
+							}
+						}
+					}
+
+					if (len <= BATCH_STRING_LEN) {
+						memcpy(batch[batched], candidate, BATCH_STRING_LEN);
+						if (++batched == WORDLIST_BATCH_SIZE) {
+							wordlist_flush(state, batch, hashes, batched);
+							batched = 0;
+						}
+					}
+
+					int i = 0;
+					while (i < rule->num_segments && ++digits[i] == rule->segments[i].size) {
+						digits[i++] = 0;
+					}
+					done = (i == rule->num_segments);
+					changed = i;
+					rebuild = (len > BATCH_STRING_LEN);
+					for (int j = 0; j <= i && j < rule->num_segments; j++) {
+						rebuild |= (rule->segments[j].type != RULE_CHARS && rule->segments[j].size > 1);
+					}
+				}
+			}
+		}
+	}
+	wordlist_flush(state, batch, hashes, batched);
+
+	free(hashes);
+	free(batch);
+	free(words);
+	return NULL;
+}
+
+/**
+ * Loads the whole wordlist, for the rules which join words
+ */
+static void wordlist_load_pairs(wordlist_state_t* state, jhash_args_t* args)
+{
+	uint64_t max_words = ((uint64_t)args->heap_mb*1024*1024)/sizeof(wordlist_word_t);
+	uint64_t capacity = 0;
+	wordlist_word_t word;
+	while (wordlist_read_word(state->fd, word)) {
+		if (state->num_pair_words == max_words) {
+			print_error("wordlist too large to join words, try increasing the heap size", EXIT_FAILURE);
+		}
+		if (state->num_pair_words == capacity) {
+			capacity = capacity ? capacity*2 : 1024;
+			state->pair_words = (wordlist_word_t*)realloc(state->pair_words, capacity*sizeof(wordlist_word_t));
+			if (!state->pair_words) {
+				print_error("unable to allocate wordlist", EXIT_FAILURE);
+			}
+		}
+		memcpy(state->pair_words[state->num_pair_words++], word, sizeof(wordlist_word_t));
+	}
+	rewind(state->fd);
+
+	for (int r = 0; r < state->num_rules; r++) {
+		for (int i = 0; i < state->rules[r].num_segments; i++) {
+			if (state->rules[r].segments[i].type == RULE_PAIR_WORD) {
+				state->rules[r].segments[i].size = state->num_pair_words;
+			}
+		}
+	}
+}
+
+/**
+ * Attempt to crack the target hashes by hashing the candidates built from a wordlist
+ */
+void crack_wordlist(jhash_args_t* args)
+{
+	target_set_t targets;
+	crack_load_targets(args, &targets);
+
+	wordlist_state_t state;
+	memset(&state, 0, sizeof(wordlist_state_t));
+	state.targets = &targets;
+	pthread_mutex_init(&state.read_lock, NULL);
+	pthread_mutex_init(&state.report_lock, NULL);
+
+	/* parse the rules, defaulting to the words as they are */
+	static char* default_rules[] = { "?w" };
+	char** rule_specs = args->num_rules > 0 ? args->rules : default_rules;
+	state.num_rules = args->num_rules > 0 ? args->num_rules : 1;
+	state.rules = (rule_t*)malloc(state.num_rules*sizeof(rule_t));
+	bool pairs = false;
+	for (int r = 0; r < state.num_rules; r++) {
+		if (!rule_parse(&state.rules[r], rule_specs[r], args)) {
+			char message[255];
+			sprintf(message, "%.200s: invalid rule", rule_specs[r]);
+			print_error(message, EXIT_FAILURE);
+		}
+		for (int i = 0; i < state.rules[r].num_segments; i++) {
+			pairs |= (state.rules[r].segments[i].type == RULE_PAIR_WORD);
+		}
+	}
+
+	state.fd = stdin;
+	if (strcmp(args->wordlist_path, "-") != 0) {
+		state.fd = fopen(args->wordlist_path, "r");
+	} else if (pairs) {
+		print_error("rules joining words need a wordlist file", EXIT_FAILURE);
+	}
+	if (!state.fd) {
+		char message[255];
+		sprintf(message, "%.200s: unable to open wordlist for reading", args->wordlist_path);
+		print_error(message, EXIT_FAILURE);
+	}
+	if (pairs) {
+		wordlist_load_pairs(&state, args);
+	}
+
+	int num_threads = args->threads;
+	pthread_t threads[num_threads];
+	for (int i = 0; i < num_threads; i++) {
+		if (pthread_create(&threads[i], NULL, wordlist_worker_run, &state) != 0) {
+			print_error("unable to start worker thread", EXIT_FAILURE);
+		}
+	}
+	for (int i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	for (size_t i = 0; i < targets.count; i++) {
+		jhash_t hash = targets.targets[i];
+		if (!targets.found[target_set_find(&targets, hash)]) {
+			fprintf(stderr, "unable to find result for %x (searched %lu)\n", hash, (unsigned long)state.candidates);
+		}
+	}
+
+	if (state.fd != stdin) {
+		fclose(state.fd);
+	}
+	pthread_mutex_destroy(&state.read_lock);
+	pthread_mutex_destroy(&state.report_lock);
+	free(state.pair_words);
+	free(state.rules);
+	target_set_free(&targets);
+}